@@ -0,0 +1,94 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ArchiveSink.h"
+#include "Trace.h"
+#include <iostream>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+ArchiveSink::ArchiveSink(std::shared_ptr<MoriaOptions> options)
+    : outDir(options->outDir()),
+      maxBytes(static_cast<uint64_t>(options->archiveMaxSize()) << 20),
+      verbose(options->verbose()),
+      encoder(options->jpegQuality(), options->jpegSubsampling(),
+              options->jpegProgressive()),
+      bytes(0) {}
+
+ArchiveSink::~ArchiveSink() { close(); }
+
+int ArchiveSink::formats() const { return OUTPUT_BGR | OUTPUT_YCRCB; }
+
+std::string ArchiveSink::write(const OutputFrame &frame,
+                               const SaveTime &saved) {
+  bool encoded;
+  {
+    TRACE_SCOPE("archive encode");
+    encoded = frame.hasPlanes() ? encoder.encodePlanes(frame.ycrcb)
+                                : encoder.encode(frame.bgr);
+  }
+  if (!encoded) {
+    std::cerr << "Warning: unable to encode archive frame" << ENDL;
+    return std::string();
+  }
+  const std::vector<uchar> &data = encoder.data();
+
+  std::string day = saved.format("%Y-%m-%d");
+  if (archive && (day != archiveDay ||
+                  (maxBytes && archive->bytes() + data.size() > maxBytes))) {
+    close();
+  }
+  try {
+    TRACE_SCOPE("archive append");
+    if (!archive) {
+      // named by start time so a restart never appends to an old archive
+      std::string dir = cv::utils::fs::join(outDir, day);
+      cv::utils::fs::createDirectories(dir);
+      std::string path =
+          cv::utils::fs::join(dir, saved.stem() + FRAME_ARCHIVE_DATA_EXT);
+      archive.reset(new FrameArchiveWriter(path));
+      archiveDay = day;
+      if (verbose) {
+        std::cerr << "open archive: " << path << ENDL;
+      }
+    }
+    int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(
+                       saved.time.time_since_epoch())
+                       .count();
+    archive->append(time, data.data(), data.size());
+  } catch (const std::runtime_error &ex) {
+    // keep capturing; the next saved frame starts a new archive
+    std::cerr << "Warning: " << ex.what() << ENDL;
+    archive.reset();
+    return std::string();
+  }
+  bytes += data.size();
+  return archive->path();
+}
+
+void ArchiveSink::close() {
+  if (archive && verbose) {
+    std::cerr << "close archive: " << archive->path() << " ("
+              << archive->frames() << " frames)" << ENDL;
+  }
+  archive.reset();
+}
+
+uint64_t ArchiveSink::bytesWritten() const { return bytes; }
+
+uint64_t ArchiveSink::memory(cv::Size size, int channels) const {
+  return JpegEncoder::memory(size, channels);
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef E2A7C4B9_5D13_4F80_9E6B_1C8F03A5D742
+#define E2A7C4B9_5D13_4F80_9E6B_1C8F03A5D742
+
+#include "FrameArchive.h"
+#include "FrameSink.h"
+#include "JpegEncoder.h"
+#include "moria_options.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Appends saved frames as JPEG images to a packed archive per day:
+// <outDir>/<YYYY-MM-DD>/<YYYY-MM-DD_HH-MM-SS>-<ms>.mfa (+ .mfi index)
+// A new archive starts when the day changes, when the archive reaches the
+// maximum size, or after a restart. Use moria-archive to list and extract
+// frames.
+class ArchiveSink : public FrameSink {
+private:
+  std::string outDir;
+  uint64_t maxBytes;
+  bool verbose;
+  JpegEncoder encoder;
+
+  std::unique_ptr<FrameArchiveWriter> archive;
+  std::string archiveDay;
+  uint64_t bytes;
+
+public:
+  explicit ArchiveSink(std::shared_ptr<MoriaOptions> options);
+  virtual ~ArchiveSink();
+
+  virtual int formats() const;
+  virtual std::string write(const OutputFrame &frame, const SaveTime &saved);
+  virtual void close();
+  virtual uint64_t bytesWritten() const;
+  virtual uint64_t memory(cv::Size size, int channels) const;
+};
+
+#endif /* E2A7C4B9_5D13_4F80_9E6B_1C8F03A5D742 */
@@ -0,0 +1,161 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "BayerFormat.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cctype>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <stdexcept>
+
+BayerFormat::BayerFormat(const std::string &pattern, u_int bits, bool packed)
+    : demosaicCode_(-1), bits_(bits), packed_(packed) {
+  std::string p(pattern);
+  std::transform(p.begin(), p.end(), p.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+
+  // OpenCV names Bayer conversions after the second row of the pattern
+  if (p.empty()) {
+    demosaicCode_ = -1;
+  } else if (p == "RGGB") {
+    demosaicCode_ = cv::COLOR_BayerBG2BGR;
+  } else if (p == "GRBG") {
+    demosaicCode_ = cv::COLOR_BayerGB2BGR;
+  } else if (p == "GBRG") {
+    demosaicCode_ = cv::COLOR_BayerGR2BGR;
+  } else if (p == "BGGR") {
+    demosaicCode_ = cv::COLOR_BayerRG2BGR;
+  } else {
+    std::stringstream errs;
+    errs << "Moria: Unknown Bayer pattern (" << pattern << ")";
+    throw std::runtime_error(errs.str());
+  }
+
+  if (bits_ != 8 && bits_ != 10 && bits_ != 12) {
+    std::stringstream errs;
+    errs << "Moria: Unsupported raw bit depth (" << bits_ << ")";
+    throw std::runtime_error(errs.str());
+  }
+  if (bits_ == 8) {
+    packed_ = false;
+  }
+}
+
+bool BayerFormat::enabled() const { return demosaicCode_ >= 0; }
+
+u_int BayerFormat::bits() const { return bits_; }
+
+bool BayerFormat::packed() const { return packed_; }
+
+double BayerFormat::scale() const { return 1.0 / ((1u << bits_) - 1); }
+
+size_t BayerFormat::rowBytes(int width) const {
+  if (packed_) {
+    return (static_cast<size_t>(width) * bits_ + 7) / 8;
+  }
+  return static_cast<size_t>(width) * (bits_ > 8 ? 2 : 1);
+}
+
+void BayerFormat::unpack(const cv::Mat &raw, cv::Size size,
+                         cv::Mat &mosaic) const {
+  size_t minStride = rowBytes(size.width);
+  size_t rawBytes = raw.total() * raw.elemSize();
+  size_t stride;
+
+  if (raw.rows == size.height && raw.cols * raw.elemSize() >= minStride) {
+    stride = raw.step;
+  } else if (raw.isContinuous() && size.height > 0 &&
+             rawBytes >= minStride * size.height) {
+    // flat buffer; rows may be padded by the driver
+    stride = rawBytes / size.height;
+  } else {
+    throw std::runtime_error(
+        "Moria: raw frame does not match the configured Bayer format.");
+  }
+
+  if (!packed_) {
+    // wrap the capture buffer; no copy needed
+    mosaic = cv::Mat(size, bits_ > 8 ? CV_16UC1 : CV_8UC1, raw.data, stride);
+    return;
+  }
+
+  mosaic.create(size, CV_16UC1);
+  if (bits_ == 10) {
+    unpack10(raw, stride, mosaic);
+  } else {
+    unpack12(raw, stride, mosaic);
+  }
+}
+
+// MIPI RAW10: four pixels in five bytes; bytes 0-3 hold the high eight bits,
+// byte 4 holds the low two bits of each pixel. A partial group at the end of
+// a row holds width % 4 high bytes followed by their low bits in one byte.
+void BayerFormat::unpack10(const cv::Mat &raw, size_t stride,
+                           cv::Mat &mosaic) const {
+  const uchar *base = raw.data;
+  int width = mosaic.cols;
+  // unpack() rejects rows shorter than this; nothing past it is read
+  CV_Assert(stride >= rowBytes(width));
+  const cv::Range rows(0, mosaic.rows);
+  WorkerPool::parallel_for(rows, [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; y++) {
+      const uchar *src = base + y * stride;
+      ushort *dst = mosaic.ptr<ushort>(y);
+      int x = 0;
+      for (; x + 4 <= width; x += 4, src += 5) {
+        uchar lo = src[4];
+        dst[x + 0] = static_cast<ushort>((src[0] << 2) | (lo & 0x03));
+        dst[x + 1] = static_cast<ushort>((src[1] << 2) | ((lo >> 2) & 0x03));
+        dst[x + 2] = static_cast<ushort>((src[2] << 2) | ((lo >> 4) & 0x03));
+        dst[x + 3] = static_cast<ushort>((src[3] << 2) | ((lo >> 6) & 0x03));
+      }
+      const int tail = width - x;
+      for (int i = 0; i < tail; i++) {
+        dst[x + i] = static_cast<ushort>((src[i] << 2) |
+                                         ((src[tail] >> (2 * i)) & 0x03));
+      }
+    }
+  });
+}
+
+// MIPI RAW12: two pixels in three bytes; bytes 0-1 hold the high eight bits,
+// byte 2 holds the low nibble of each pixel. An odd last pixel takes two
+// bytes, its high bits and then its low nibble.
+void BayerFormat::unpack12(const cv::Mat &raw, size_t stride,
+                           cv::Mat &mosaic) const {
+  const uchar *base = raw.data;
+  int width = mosaic.cols;
+  CV_Assert(stride >= rowBytes(width));
+  const cv::Range rows(0, mosaic.rows);
+  WorkerPool::parallel_for(rows, [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; y++) {
+      const uchar *src = base + y * stride;
+      ushort *dst = mosaic.ptr<ushort>(y);
+      int x = 0;
+      for (; x + 2 <= width; x += 2, src += 3) {
+        uchar lo = src[2];
+        dst[x + 0] = static_cast<ushort>((src[0] << 4) | (lo & 0x0F));
+        dst[x + 1] = static_cast<ushort>((src[1] << 4) | (lo >> 4));
+      }
+      if (x < width) {
+        dst[x] = static_cast<ushort>((src[0] << 4) | (src[1] & 0x0F));
+      }
+    }
+  });
+}
+
+void BayerFormat::demosaic(const cv::Mat &mosaic, cv::Mat &bgr) const {
+  cv::cvtColor(mosaic, bgr, demosaicCode_);
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef E3B1A6F2_5C8D_4E0A_9B7F_2D4C6A8E1F30
+#define E3B1A6F2_5C8D_4E0A_9B7F_2D4C6A8E1F30
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <sys/types.h>
+
+// Describes a raw Bayer capture format. Raw frames are unpacked into a single
+// mosaic plane (CV_8UC1 for 8-bit, CV_16UC1 otherwise) so that the temporal
+// filter can run on one third of the data of a demosaiced frame.
+class BayerFormat {
+private:
+  int demosaicCode_;
+  u_int bits_;
+  bool packed_;
+
+  void unpack10(const cv::Mat &raw, size_t stride, cv::Mat &mosaic) const;
+  void unpack12(const cv::Mat &raw, size_t stride, cv::Mat &mosaic) const;
+
+public:
+  // pattern is the sensor colour filter layout (RGGB, GRBG, GBRG or BGGR);
+  // an empty pattern disables raw Bayer mode.
+  BayerFormat(const std::string &pattern, u_int bits, bool packed);
+
+  bool enabled() const;
+  u_int bits() const;
+  bool packed() const;
+
+  // scale factor which normalizes mosaic samples to [0, 1]
+  double scale() const;
+
+  // bytes occupied by one row of width pixels in the raw buffer
+  size_t rowBytes(int width) const;
+
+  // convert a raw capture buffer (either a 2D plane or a flat byte buffer as
+  // returned by backends with RGB conversion disabled) into a mosaic plane
+  void unpack(const cv::Mat &raw, cv::Size size, cv::Mat &mosaic) const;
+
+  // demosaic an 8-bit or 16-bit mosaic plane into an interleaved BGR frame
+  void demosaic(const cv::Mat &mosaic, cv::Mat &bgr) const;
+};
+
+#endif /* E3B1A6F2_5C8D_4E0A_9B7F_2D4C6A8E1F30 */
@@ -13,79 +13,207 @@
 // limitations under the License.
 
 #include "CameraManager.h"
+#include "JpegDirectorySource.h"
+#include "SharedFrameSource.h"
+#include "SyntheticFrameSource.h"
+#include "Trace.h"
+#include "VideoCaptureSource.h"
 #include "moria_options.h"
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <opencv2/core/version.hpp>
 #include <sstream>
+#include <thread>
 
 #define ENDL "\n"
 
-CameraManager::CameraManager(cv::VideoCapture &&cam) : c(std::move(cam)) {}
+// consecutive empty frames before the camera is considered lost
+#define EMPTY_FRAME_LIMIT 10
+// first reconnect delay (seconds); doubled after every failed attempt
+#define RECONNECT_INITIAL_DELAY 0.5
+// longest wait (ms) between checks for a stop during a reconnect delay
+#define RECONNECT_STOP_CHECK 100
 
-void CameraManager::configure(std::shared_ptr<MoriaOptions> options) {
-  if (options->gstPipeline().empty()) {
-    c.open(options->deviceID(), options->apiID());
-    c.set(cv::CAP_PROP_FRAME_WIDTH, options->frameWidth());
-    c.set(cv::CAP_PROP_FRAME_HEIGHT, options->frameHeight());
-    c.set(cv::CAP_PROP_FPS, options->captureFPS());
+CameraManager::CameraManager()
+    : bayer("", 8, false), maxReconnectDelay(0), verbose(false),
+      reconnects_(0) {}
+
+void CameraManager::configure(std::shared_ptr<MoriaOptions> options,
+                              const std::string &tag) {
+  this->tag = tag;
+  verbose = options->verbose();
+  maxReconnectDelay = std::max(RECONNECT_INITIAL_DELAY,
+                               static_cast<double>(options->reconnectDelay()));
+  reopen = nullptr;
+
+  if (options->synthetic()) {
+    source.reset(new SyntheticFrameSource(options));
+  } else if (!options->replayDir().empty()) {
+    source.reset(new JpegDirectorySource(options));
+  } else if (!options->shmSource().empty()) {
+    // published frames are already unpacked; the Bayer pattern still
+    // selects the demosaicing pipeline
+    bayer = BayerFormat(options->bayerPattern(), options->rawBits(), false);
+    source.reset(new SharedFrameSource(options));
+    reopen = [options]() { return new SharedFrameSource(options); };
   } else {
-    c.open(options->gstPipeline());
+    bayer = BayerFormat(options->bayerPattern(), options->rawBits(),
+                        options->rawPacked());
+    source.reset(new VideoCaptureSource(options, bayer));
+    const BayerFormat format = bayer;
+    reopen = [options, format]() {
+      return new VideoCaptureSource(options, format);
+    };
   }
-  if (options->verbose()) {
-    int fourcc = c.get(cv::CAP_PROP_FOURCC);
-    std::cerr << "Opened camera using " << c.getBackendName() << " backend."
-              << ENDL;
-    if (options->gstPipeline().empty()) {
-      std::cerr << "Camera deviceID: " << options->deviceID() << ENDL;
-    } else {
-      std::cerr << "gstreamer pipeline: \"" << options->gstPipeline() << "\""
-                << ENDL;
-    }
-    std::cerr << "frame width:  " << c.get(cv::CAP_PROP_FRAME_WIDTH) << ENDL;
-    std::cerr << "frame height: " << c.get(cv::CAP_PROP_FRAME_HEIGHT) << ENDL;
-    std::cerr << "FPS:          " << c.get(cv::CAP_PROP_FPS) << ENDL;
-    if (fourcc)
-      std::cerr << "FOURCC:       " << static_cast<char>(fourcc)
-                << static_cast<char>(fourcc >> 8)
-                << static_cast<char>(fourcc >> 16)
-                << static_cast<char>(fourcc >> 24) << ENDL;
+  if (!options->reconnect()) {
+    reopen = nullptr;
+  }
+
+  if (!options->publishShm().empty()) {
+    bus.reset(new SharedFrameBus(options->publishShm(), options->shmSlots()));
   }
 }
 
 CameraManager &CameraManager::set(cv::VideoCaptureProperties prop,
                                   double value) {
-  if (this->c.isOpened()) {
-    this->c.set(prop, value);
+  if (this->isOpened()) {
+    this->source->set(prop, value);
   } else {
-    std::cerr
-        << "Warning: Attempted to set property on unopended video capture."
-        << "\n";
+    std::cerr << tag
+              << "Warning: Attempted to set property on unopended video "
+                 "capture."
+              << "\n";
   }
   return *this;
 }
 
-bool CameraManager::isOpened() { return this->c.isOpened(); }
+bool CameraManager::isOpened() { return source && source->isOpened(); }
 
-CameraManager &
-CameraManager::with_frames(std::function<bool(cv::Mat &frame)> handler) {
+const BayerFormat &CameraManager::bayerFormat() const { return this->bayer; }
+
+int64_t CameraManager::droppedFrames() const { return gaps.dropped(); }
+
+int64_t CameraManager::reconnects() const { return reconnects_; }
+
+CameraManager &CameraManager::stopWhen(std::function<bool()> stop) {
+  stopRequested = stop;
+  return *this;
+}
+
+bool CameraManager::stopping() const {
+  return stopRequested && stopRequested();
+}
+
+bool CameraManager::recover(const std::string &reason) {
+  std::cerr << tag << "Camera lost (" << reason << "); reconnecting" << ENDL;
+  source.reset();
+
+  double delay = RECONNECT_INITIAL_DELAY;
+  for (int attempt = 1;; attempt++) {
+    // wait in short steps so a stop does not sit out the whole delay
+    auto until = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(static_cast<int64_t>(delay * 1000));
+    for (auto now = std::chrono::steady_clock::now(); now < until;
+         now = std::chrono::steady_clock::now()) {
+      if (stopping()) {
+        std::cerr << tag << "reconnect abandoned" << ENDL;
+        return false;
+      }
+      std::this_thread::sleep_for(
+          std::min<std::chrono::steady_clock::duration>(
+              until - now, std::chrono::milliseconds(RECONNECT_STOP_CHECK)));
+    }
+    try {
+      source.reset(reopen());
+      if (source->isOpened()) {
+        break;
+      }
+    } catch (const std::exception &ex) {
+      if (verbose) {
+        std::cerr << tag << "reconnect attempt " << attempt << ": "
+                  << ex.what() << ENDL;
+      }
+    }
+    source.reset();
+    delay = std::min(delay * 2, maxReconnectDelay);
+    if (verbose) {
+      std::cerr << tag << "reconnect attempt " << attempt
+                << " failed; retrying in " << delay << " s" << ENDL;
+    }
+  }
+
+  reconnects_++;
+  std::cerr << tag << "Camera reconnected" << ENDL;
+  return true;
+}
+
+CameraManager &CameraManager::with_frames(
+    std::function<bool(cv::Mat &frame, const FrameInfo &info)> handler) {
   if (!this->isOpened()) {
     throw std::runtime_error("Moria: camera not open.");
   }
-  for (cv::Mat frame; handler(frame);) {
+  FrameInfo info;
+  int emptyFrames = 0;
+  bool resumed = false;
+  auto lastFrame = std::chrono::steady_clock::now();
+
+  for (cv::Mat frame; handler(frame, info);) {
+    if (stopping()) {
+      break;
+    }
+    std::string lost;
     try {
-      c >> frame;
+      TRACE_SCOPE("capture");
+      if (!source->read(frame, info)) {
+        if (!reopen) {
+          break; // end of stream
+        }
+        lost = "end of stream";
+      }
     } catch (const std::exception &ex) {
-      std::stringstream what("Moria: Error grabbing frame. ");
-      what << ex.what();
-      throw std::runtime_error(what.str());
+      if (!reopen) {
+        std::stringstream what("Moria: Error grabbing frame. ");
+        what << ex.what();
+        throw std::runtime_error(what.str());
+      }
+      lost = ex.what();
+    }
+
+    if (lost.empty() && frame.empty() && ++emptyFrames >= EMPTY_FRAME_LIMIT) {
+      if (!reopen) {
+        throw std::runtime_error("Moria: encountered too many empty frames.");
+      }
+      lost = "no frames";
+    }
+    if (!lost.empty()) {
+      // the filter state lives with the caller and survives the outage
+      frame.release();
+      if (!recover(lost)) {
+        break;
+      }
+      emptyFrames = 0;
+      resumed = true;
+      continue;
+    }
+    if (frame.empty()) {
+      continue;
+    }
+
+    // count the whole outage as missed frames so the filter keeps its
+    // time base
+    auto now = std::chrono::steady_clock::now();
+    info.dropped = resumed ? gaps.resume(info, now - lastFrame)
+                           : gaps.update(info);
+    lastFrame = now;
+    emptyFrames = 0;
+    resumed = false;
+    if (bus) {
+      TRACE_SCOPE("publish");
+      bus->publish(frame, info);
     }
   }
   return *this;
 }
 
-CameraManager::~CameraManager() {
-  if (c.isOpened()) {
-    c.release();
-  }
-}
+CameraManager::~CameraManager() {}
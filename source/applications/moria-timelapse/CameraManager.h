@@ -15,22 +15,58 @@
 #ifndef C34B2E44_EC72_46CD_B573_F61A40F34B0B
 #define C34B2E44_EC72_46CD_B573_F61A40F34B0B
 
+#include "BayerFormat.h"
+#include "FrameGapDetector.h"
+#include "FrameSource.h"
+#include "SharedFrameBus.h"
 #include "moria_options.h"
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <opencv2/videoio.hpp>
+#include <string>
 #include <utility>
 
 class CameraManager {
 private:
-  cv::VideoCapture c;
+  std::unique_ptr<FrameSource> source;
+  BayerFormat bayer;
+  FrameGapDetector gaps;
+  std::unique_ptr<SharedFrameBus> bus;
+
+  // reopens the current source after a camera reset (null if the source
+  // cannot be reopened, e.g. synthetic or replayed frames)
+  std::function<FrameSource *()> reopen;
+  double maxReconnectDelay;
+  bool verbose;
+  int64_t reconnects_;
+  // log prefix identifying the camera
+  std::string tag;
+  // asked from the capture thread whether to stop
+  std::function<bool()> stopRequested;
+
+  bool stopping() const;
+  // close the source and reopen it with exponential backoff; false if asked
+  // to stop before the source was reopened
+  bool recover(const std::string &reason);
 
 public:
-  explicit CameraManager(cv::VideoCapture &&cam);
-  void configure(std::shared_ptr<MoriaOptions> options);
+  CameraManager();
+  void configure(std::shared_ptr<MoriaOptions> options,
+                 const std::string &tag = std::string());
+  // end with_frames, and any reconnect attempts, once stop returns true; it
+  // is checked for every frame and throughout the reconnect delays
+  CameraManager &stopWhen(std::function<bool()> stop);
   CameraManager &set(cv::VideoCaptureProperties prop, double value);
   bool isOpened();
-  CameraManager &with_frames(std::function<bool(cv::Mat &frame)> handler);
+  const BayerFormat &bayerFormat() const;
+  CameraManager &
+  with_frames(std::function<bool(cv::Mat &frame, const FrameInfo &info)>
+                  handler);
+  // frames lost by the capture device since the camera was opened
+  int64_t droppedFrames() const;
+  // number of times the source was reopened
+  int64_t reconnects() const;
   ~CameraManager();
 };
 
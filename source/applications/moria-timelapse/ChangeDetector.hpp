@@ -40,6 +40,11 @@ public:
     }
     return *this;
   }
+  // compare later values against value
+  ChangeDetector &reset(T value) {
+    v0 = value;
+    return *this;
+  }
 };
 
 #endif /* D1CF5BD8_6FCE_4518_952B_173917229B87 */
@@ -14,33 +14,142 @@
 
 
 #include "FPSCounter.h"
-#include <chrono>
-#include <iostream>
+#include <algorithm>
+#include <vector>
 
-FPSCounter::FPSCounter()
-    : t0(std::chrono::high_resolution_clock::now()), frames(0), _fps(0.0f) {}
+static int64_t steady_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+FPSCounter::FPSCounter(size_t frames, double seconds)
+    : slots(new Slot[std::max<size_t>(frames, 2) + 1]),
+      capacity(std::max<size_t>(frames, 2) + 1),
+      window(static_cast<int64_t>(seconds * 1e9)), head(0), base(0),
+      samples(0) {
+  reset();
+}
 
 FPSCounter::~FPSCounter() {}
 
+void FPSCounter::push(int64_t time) {
+  uint64_t h = head.load(std::memory_order_relaxed);
+  Slot &slot = slots[h % capacity];
+  // seqlock writer: a reader that sees the stores below also sees every
+  // earlier head, so its recheck notices that the slot was overwritten
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.time.store(time, std::memory_order_relaxed);
+  slot.samples.store(samples, std::memory_order_relaxed);
+  // publishes the slot to readers
+  head.store(h + 1, std::memory_order_release);
+}
+
 FPSCounter &FPSCounter::reset() {
-  this->t0 = std::chrono::high_resolution_clock::now();
-  this->frames = 0;
+  // the marker is published before it becomes the window start
+  uint64_t marker = head.load(std::memory_order_relaxed);
+  push(steady_now());
+  base.store(marker, std::memory_order_release);
   return *this;
 }
 
-FPSCounter &FPSCounter::update() {
-  this->frames++;
+FPSCounter &FPSCounter::update(int64_t frames) {
+  samples += frames;
+  push(steady_now());
   return *this;
 }
 
-float FPSCounter::fps() {
-  if (this->frames == 0) {
-    return this->_fps;
+bool FPSCounter::span(uint64_t &first, uint64_t &last) const {
+  uint64_t h = head.load(std::memory_order_acquire);
+  uint64_t b = base.load(std::memory_order_acquire);
+  // the writer may be overwriting the slot one lap behind it
+  uint64_t oldest = std::max(b, h >= capacity ? h - capacity + 1 : 0);
+  last = h - 1;
+  // the start marker only counts until two updates follow it
+  if (oldest == b && last - oldest >= 2) {
+    oldest++;
+  }
+  // the window is in time order: binary search its first update
+  int64_t from =
+      slots[last % capacity].time.load(std::memory_order_relaxed) - window;
+  uint64_t lo = oldest, hi = last;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (slots[mid % capacity].time.load(std::memory_order_relaxed) < from) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  // after a gap longer than the window, rate the last interval
+  first = lo == last && lo > oldest ? lo - 1 : lo;
+  return current(first);
+}
+
+bool FPSCounter::current(uint64_t first) const {
+  // orders the slot loads before the head load (seqlock reader)
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return head.load(std::memory_order_relaxed) - first < capacity;
+}
+
+float FPSCounter::fps() const {
+  uint64_t first, last;
+  for (int attempt = 0; attempt < 4; attempt++) {
+    if (!span(first, last)) {
+      continue;
+    }
+    const Slot &a = slots[first % capacity], &b = slots[last % capacity];
+    int64_t frames = b.samples.load(std::memory_order_relaxed) -
+                     a.samples.load(std::memory_order_relaxed);
+    int64_t elapsed = b.time.load(std::memory_order_relaxed) -
+                      a.time.load(std::memory_order_relaxed);
+    if (!current(first)) {
+      continue;
+    }
+    if (frames <= 0 || elapsed <= 0) {
+      return 0.0f;
+    }
+    return static_cast<float>(frames * 1e9 / elapsed);
+  }
+  return 0.0f;
+}
+
+FrameTiming FPSCounter::timing() const {
+  FrameTiming timing{fps(), 0, 0, 0, 0};
+  std::vector<double> intervals;
+  uint64_t first, last;
+  for (int attempt = 0; attempt < 4; attempt++) {
+    intervals.clear();
+    if (!span(first, last)) {
+      continue;
+    }
+    // the interval from the start marker includes start-up time
+    first = std::max(first, base.load(std::memory_order_relaxed) + 1);
+    for (uint64_t i = first; i < last; i++) {
+      const Slot &a = slots[i % capacity], &b = slots[(i + 1) % capacity];
+      int64_t frames = b.samples.load(std::memory_order_relaxed) -
+                       a.samples.load(std::memory_order_relaxed);
+      int64_t elapsed = b.time.load(std::memory_order_relaxed) -
+                        a.time.load(std::memory_order_relaxed);
+      if (frames > 0) {
+        intervals.push_back(static_cast<double>(elapsed) / frames / 1e9);
+      }
+    }
+    if (current(first)) {
+      break;
+    }
+  }
+  if (intervals.empty()) {
+    return timing;
   }
-  auto now = std::chrono::high_resolution_clock::now();
-  auto elapsed_time = (std::chrono::nanoseconds(now - this->t0).count()) / 1e9f;
-  this->_fps = static_cast<float>(this->frames / elapsed_time);
-  this->frames = 0;
-  this->t0 = now;
-  return this->_fps;
+  std::sort(intervals.begin(), intervals.end());
+  auto percentile = [&](double p) {
+    size_t i = static_cast<size_t>(p * static_cast<double>(intervals.size()));
+    return intervals[std::min(i, intervals.size() - 1)];
+  };
+  timing.p50 = percentile(0.5);
+  timing.p90 = percentile(0.9);
+  timing.p99 = percentile(0.99);
+  timing.max = intervals.back();
+  return timing;
 }
@@ -12,24 +12,64 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+
 #ifndef BA8FE04C_D06D_48E6_BBDA_42552B2B96FE
 #define BA8FE04C_D06D_48E6_BBDA_42552B2B96FE
 
+#include <atomic>
 #include <chrono>
-#include <functional>
+#include <cstdint>
+#include <memory>
+
+// window of the frame rate estimate: the last FPS_WINDOW_FRAMES updates, at
+// most FPS_WINDOW_SECONDS old
+#define FPS_WINDOW_FRAMES 512
+#define FPS_WINDOW_SECONDS 5
+
+// Frame rate and inter-frame interval percentiles (seconds) over the window
+struct FrameTiming {
+  float fps;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
 
+// Sliding-window frame rate estimator. Each update records its arrival time
+// in a ring buffer (O(1)); fps() is exact over the window, so its value does
+// not depend on how often it is read. Updates come from one thread; fps() and
+// timing() may be called from any thread without locking.
 class FPSCounter {
 private:
-  std::chrono::time_point<std::chrono::high_resolution_clock> t0;
-  int frames;
-  float _fps;
+  struct Slot {
+    std::atomic<int64_t> time;    // steady_clock nanoseconds
+    std::atomic<int64_t> samples; // cumulative frames at this update
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  uint64_t capacity;
+  int64_t window;
+  // updates written; the slot of update i is i % capacity
+  std::atomic<uint64_t> head;
+  // update at which the window (re)started; it marks the start time only
+  std::atomic<uint64_t> base;
+  int64_t samples;
+
+  void push(int64_t time);
+  // first and last update of the window; false if it was overwritten
+  bool span(uint64_t &first, uint64_t &last) const;
+  // false if slots read since span() may have been overwritten from first
+  bool current(uint64_t first) const;
 
 public:
-  FPSCounter();
+  explicit FPSCounter(size_t frames = FPS_WINDOW_FRAMES,
+                      double seconds = FPS_WINDOW_SECONDS);
   ~FPSCounter();
   FPSCounter &reset();
-  FPSCounter &update();
-  float fps();
+  FPSCounter &update(int64_t frames = 1);
+  float fps() const;
+  // allocates and sorts the window; meant for periodic reporting
+  FrameTiming timing() const;
 };
 
 #endif /* BA8FE04C_D06D_48E6_BBDA_42552B2B96FE */
@@ -0,0 +1,163 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FilterCheckpoint.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static std::runtime_error checkpoint_error(const std::string &what,
+                                           const std::string &path) {
+  std::stringstream errs;
+  errs << "Moria: " << what << " (" << path << "): " << std::strerror(errno);
+  return std::runtime_error(errs.str());
+}
+
+FilterCheckpoint::FilterCheckpoint(const std::string &path) : path(path) {}
+
+const std::string &FilterCheckpoint::file() const { return path; }
+
+void FilterCheckpoint::save(const FramePipeline &pipeline,
+                            Butterworth2ndOrderIIRFilterParams<float> &params) {
+  std::vector<cv::Mat> planes = pipeline.state();
+  if (planes.empty()) {
+    return;
+  }
+
+  FilterCheckpointHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, FILTER_CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = FILTER_CHECKPOINT_VERSION;
+  header.kind = static_cast<uint32_t>(pipeline.kind());
+  header.planes = static_cast<uint32_t>(planes.size());
+  header.rows = planes[0].rows;
+  header.cols = planes[0].cols;
+  header.type = planes[0].type();
+  header.passband = params.passband();
+  header.samplerate = params.samplerate();
+  header.gain = params.gain();
+  header.savedAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+  header.planeBytes = planes[0].total() * planes[0].elemSize();
+  header.dataOffset = (sizeof(header) + 63) / 64 * 64;
+  size_t fileBytes = header.dataOffset + header.planeBytes * planes.size();
+
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0) {
+    throw checkpoint_error("Unable to create checkpoint", tmp);
+  }
+  if (ftruncate(fd, static_cast<off_t>(fileBytes)) != 0) {
+    close(fd);
+    throw checkpoint_error("Unable to size checkpoint", tmp);
+  }
+  void *base =
+      mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    throw checkpoint_error("Unable to map checkpoint", tmp);
+  }
+
+  char *data = static_cast<char *>(base);
+  std::memcpy(data, &header, sizeof(header));
+  for (size_t p = 0; p < planes.size(); p++) {
+    cv::Mat dst(header.rows, header.cols, header.type,
+                data + header.dataOffset + p * header.planeBytes);
+    planes[p].copyTo(dst);
+  }
+
+  bool synced = msync(base, fileBytes, MS_SYNC) == 0;
+  munmap(base, fileBytes);
+  close(fd);
+  if (!synced) {
+    throw checkpoint_error("Unable to write checkpoint", tmp);
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    throw checkpoint_error("Unable to replace checkpoint", path);
+  }
+
+  // make the rename itself durable
+  size_t slash = path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+  int dirfd = open(dir.empty() ? "/" : dir.c_str(), O_RDONLY);
+  if (dirfd >= 0) {
+    fsync(dirfd);
+    close(dirfd);
+  }
+}
+
+bool FilterCheckpoint::restore(
+    FramePipeline &pipeline, cv::Size filterSize,
+    Butterworth2ndOrderIIRFilterParams<float> &params,
+    std::chrono::nanoseconds &age) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(FilterCheckpointHeader)) {
+    close(fd);
+    return false;
+  }
+  size_t fileBytes = static_cast<size_t>(st.st_size);
+  void *base = mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  FilterCheckpointHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  bool valid =
+      std::memcmp(header.magic, FILTER_CHECKPOINT_MAGIC,
+                  sizeof(header.magic)) == 0 &&
+      header.version == FILTER_CHECKPOINT_VERSION &&
+      header.kind == static_cast<uint32_t>(pipeline.kind()) &&
+      header.planes == static_cast<uint32_t>(4 * pipeline.channels()) &&
+      header.rows == filterSize.height && header.cols == filterSize.width &&
+      header.type == CV_32FC1 &&
+      header.planeBytes ==
+          static_cast<uint64_t>(header.rows) * header.cols * sizeof(float) &&
+      header.dataOffset + header.planeBytes * header.planes <= fileBytes;
+
+  if (valid) {
+    // wrap the mapped planes; restore() copies them into the filter
+    char *data = static_cast<char *>(base) + header.dataOffset;
+    std::vector<cv::Mat> planes(header.planes);
+    for (size_t p = 0; p < planes.size(); p++) {
+      planes[p] = cv::Mat(header.rows, header.cols, header.type,
+                          data + p * header.planeBytes);
+    }
+    pipeline.restore(planes);
+    params.samplerate(header.samplerate);
+    pipeline.resetgain(header.gain, params.gain());
+
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    age = std::max(std::chrono::nanoseconds(0),
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(now) -
+                       std::chrono::nanoseconds(header.savedAt));
+  }
+  munmap(base, fileBytes);
+  return valid;
+}
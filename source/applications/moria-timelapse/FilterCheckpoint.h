@@ -0,0 +1,71 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef A23651C1_3FAB_421F_8532_790A64D76218
+#define A23651C1_3FAB_421F_8532_790A64D76218
+
+#include "FramePipeline.hpp"
+#include "butterworth_2nd_IIR_params.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#define FILTER_CHECKPOINT_MAGIC "MORIACK"
+#define FILTER_CHECKPOINT_VERSION 1
+
+// On-disk header; the state planes follow at dataOffset, each stored as
+// rows x cols elements of the given type without row padding.
+struct FilterCheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t kind;
+  uint32_t planes;
+  int32_t rows;
+  int32_t cols;
+  int32_t type;
+  float passband;
+  float samplerate;
+  float gain;
+  uint32_t reserved;
+  // system clock time of the checkpoint (nanoseconds since the epoch)
+  int64_t savedAt;
+  uint64_t planeBytes;
+  uint64_t dataOffset;
+};
+
+// Saves and restores the filter state of a pipeline. A checkpoint is
+// written to a temporary file through a memory mapping and renamed over
+// the previous one, so a crash leaves either the old or the new checkpoint.
+class FilterCheckpoint {
+private:
+  std::string path;
+
+public:
+  explicit FilterCheckpoint(const std::string &path);
+
+  const std::string &file() const;
+
+  void save(const FramePipeline &pipeline,
+            Butterworth2ndOrderIIRFilterParams<float> &params);
+
+  // restore the checkpoint if it was taken from a pipeline of the same kind
+  // and filter size. The sample rate is restored and the saved state is
+  // rescaled to the current gain. age is set to the time since the
+  // checkpoint was taken. Returns false if there is no usable checkpoint.
+  bool restore(FramePipeline &pipeline, cv::Size filterSize,
+               Butterworth2ndOrderIIRFilterParams<float> &params,
+               std::chrono::nanoseconds &age);
+};
+
+#endif /* A23651C1_3FAB_421F_8532_790A64D76218 */
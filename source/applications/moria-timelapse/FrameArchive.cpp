@@ -0,0 +1,273 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FrameArchive.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static std::runtime_error archive_error(const std::string &what,
+                                        const std::string &path) {
+  std::stringstream errs;
+  errs << "Moria: " << what << " (" << path << "): " << std::strerror(errno);
+  return std::runtime_error(errs.str());
+}
+
+// write all of iov, resuming after short writes and signals
+static bool write_all(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    size_t left = static_cast<size_t>(written);
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+static bool write_header(int fd, const char *magic) {
+  FrameArchiveHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, magic, sizeof(header.magic));
+  header.version = FRAME_ARCHIVE_VERSION;
+  struct iovec iov = {&header, sizeof(header)};
+  return write_all(fd, &iov, 1);
+}
+
+static bool valid_header(const void *base, size_t bytes, const char *magic) {
+  FrameArchiveHeader header;
+  if (bytes < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, base, sizeof(header));
+  return std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 &&
+         header.version == FRAME_ARCHIVE_VERSION;
+}
+
+std::string frame_archive_index_path(const std::string &dataPath) {
+  std::string ext(FRAME_ARCHIVE_DATA_EXT);
+  if (dataPath.size() >= ext.size() &&
+      dataPath.compare(dataPath.size() - ext.size(), ext.size(), ext) == 0) {
+    return dataPath.substr(0, dataPath.size() - ext.size()) +
+           FRAME_ARCHIVE_INDEX_EXT;
+  }
+  return dataPath + FRAME_ARCHIVE_INDEX_EXT;
+}
+
+FrameArchiveWriter::FrameArchiveWriter(const std::string &path)
+    : path_(path), dataFd(-1), indexFd(-1), dataBytes(0), frames_(0) {
+  // archives are only ever appended to by the process that created them
+  int flags = O_CREAT | O_EXCL | O_WRONLY | O_APPEND | O_CLOEXEC;
+  std::string indexPath = frame_archive_index_path(path);
+  dataFd = open(path.c_str(), flags, 0644);
+  if (dataFd < 0) {
+    throw archive_error("Unable to create archive", path);
+  }
+  indexFd = open(indexPath.c_str(), flags, 0644);
+  if (indexFd < 0) {
+    close(dataFd);
+    throw archive_error("Unable to create archive index", indexPath);
+  }
+  if (!write_header(dataFd, FRAME_ARCHIVE_DATA_MAGIC) ||
+      !write_header(indexFd, FRAME_ARCHIVE_INDEX_MAGIC)) {
+    close(dataFd);
+    close(indexFd);
+    throw archive_error("Unable to write archive", path);
+  }
+  dataBytes = sizeof(FrameArchiveHeader);
+}
+
+FrameArchiveWriter::~FrameArchiveWriter() {
+  fdatasync(dataFd);
+  fdatasync(indexFd);
+  close(dataFd);
+  close(indexFd);
+}
+
+const std::string &FrameArchiveWriter::path() const { return path_; }
+
+uint64_t FrameArchiveWriter::bytes() const { return dataBytes; }
+
+size_t FrameArchiveWriter::frames() const { return frames_; }
+
+void FrameArchiveWriter::append(int64_t time, const uint8_t *data,
+                                size_t size) {
+  FrameArchiveRecord record;
+  record.magic = FRAME_ARCHIVE_RECORD_MAGIC;
+  record.size = static_cast<uint32_t>(size);
+  record.time = time;
+
+  FrameArchiveEntry entry;
+  std::memset(&entry, 0, sizeof(entry));
+  entry.time = time;
+  entry.offset = dataBytes + sizeof(record);
+  entry.size = record.size;
+
+  // the record goes first so the index never points past the data
+  struct iovec frame[2] = {{&record, sizeof(record)},
+                           {const_cast<uint8_t *>(data), size}};
+  if (!write_all(dataFd, frame, 2)) {
+    throw archive_error("Unable to append to archive", path_);
+  }
+  dataBytes += sizeof(record) + size;
+  struct iovec indexed = {&entry, sizeof(entry)};
+  if (!write_all(indexFd, &indexed, 1)) {
+    throw archive_error("Unable to append to archive index",
+                        frame_archive_index_path(path_));
+  }
+  frames_++;
+}
+
+FrameArchiveReader::FrameArchiveReader(const std::string &path)
+    : path_(path), data(nullptr), dataBytes(0), index(nullptr),
+      indexBytes(0), count(0) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw archive_error("Unable to open archive", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw archive_error("Unable to open archive", path);
+  }
+  dataBytes = static_cast<size_t>(st.st_size);
+  void *base = dataBytes ? mmap(nullptr, dataBytes, PROT_READ, MAP_SHARED,
+                                fd, 0)
+                         : MAP_FAILED;
+  close(fd);
+  if (base == MAP_FAILED ||
+      !valid_header(base, dataBytes, FRAME_ARCHIVE_DATA_MAGIC)) {
+    if (base != MAP_FAILED) {
+      munmap(base, dataBytes);
+    }
+    throw std::runtime_error("Moria: Not a frame archive (" + path + ")");
+  }
+  data = static_cast<const uint8_t *>(base);
+
+  std::string indexPath = frame_archive_index_path(path);
+  fd = open(indexPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0 && fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) > sizeof(FrameArchiveHeader)) {
+    indexBytes = static_cast<size_t>(st.st_size);
+    base = mmap(nullptr, indexBytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED &&
+        valid_header(base, indexBytes, FRAME_ARCHIVE_INDEX_MAGIC)) {
+      index = reinterpret_cast<const FrameArchiveEntry *>(
+          static_cast<const uint8_t *>(base) + sizeof(FrameArchiveHeader));
+    } else if (base != MAP_FAILED) {
+      munmap(base, indexBytes);
+    }
+    if (!index) {
+      indexBytes = 0;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  // trust index entries that lie within the data file
+  if (index) {
+    size_t entries =
+        (indexBytes - sizeof(FrameArchiveHeader)) / sizeof(FrameArchiveEntry);
+    while (count < entries &&
+           index[count].offset + index[count].size <= dataBytes) {
+      count++;
+    }
+  }
+  size_t indexed =
+      count ? index[count - 1].offset + index[count - 1].size
+            : sizeof(FrameArchiveHeader);
+  if (indexed < dataBytes) {
+    // the index lags the data (crash or concurrent append): recover the
+    // remaining frames from the record headers
+    scanned.assign(index, index + count);
+    scan(indexed);
+  }
+}
+
+FrameArchiveReader::~FrameArchiveReader() {
+  munmap(const_cast<uint8_t *>(data), dataBytes);
+  if (indexBytes) {
+    munmap(const_cast<char *>(reinterpret_cast<const char *>(index)) -
+               sizeof(FrameArchiveHeader),
+           indexBytes);
+  }
+}
+
+void FrameArchiveReader::scan(size_t from) {
+  size_t offset = from;
+  FrameArchiveRecord record;
+  while (offset + sizeof(record) <= dataBytes) {
+    std::memcpy(&record, data + offset, sizeof(record));
+    size_t end = offset + sizeof(record) + record.size;
+    if (record.magic != FRAME_ARCHIVE_RECORD_MAGIC || end > dataBytes) {
+      break; // torn write at the end of the file
+    }
+    FrameArchiveEntry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    entry.time = record.time;
+    entry.offset = offset + sizeof(record);
+    entry.size = record.size;
+    scanned.push_back(entry);
+    offset = end;
+  }
+  count = scanned.size();
+}
+
+const std::string &FrameArchiveReader::path() const { return path_; }
+
+size_t FrameArchiveReader::size() const { return count; }
+
+const FrameArchiveEntry &FrameArchiveReader::entry(size_t i) const {
+  return scanned.empty() ? index[i] : scanned[i];
+}
+
+const uint8_t *FrameArchiveReader::frame(const FrameArchiveEntry &entry) const {
+  return data + entry.offset;
+}
+
+size_t FrameArchiveReader::find(int64_t time) const {
+  if (count == 0) {
+    return count;
+  }
+  // first entry saved after time
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entry(mid).time <= time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo == 0 ? 0 : lo - 1;
+}
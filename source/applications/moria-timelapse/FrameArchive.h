@@ -0,0 +1,118 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef D5F8316A_0B7C_4E29_A4D1_93C62E8B507F
+#define D5F8316A_0B7C_4E29_A4D1_93C62E8B507F
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packed frame archive: encoded frames are appended to a data file (.mfa)
+// and a fixed-size entry per frame is appended to an index file (.mfi)
+// beside it. Both files start with a FrameArchiveHeader. Integers are
+// stored in host byte order.
+//
+// data:  header, then per frame a FrameArchiveRecord followed by the
+//        encoded image
+// index: header, then one FrameArchiveEntry per frame in append order
+//
+// The index only speeds up lookups: a reader rebuilds it from the record
+// headers when it is missing or shorter than the data file.
+
+#define FRAME_ARCHIVE_DATA_MAGIC "MORIAFA"
+#define FRAME_ARCHIVE_INDEX_MAGIC "MORIAFI"
+#define FRAME_ARCHIVE_RECORD_MAGIC 0x4d46524du // "MFRM"
+#define FRAME_ARCHIVE_VERSION 1
+#define FRAME_ARCHIVE_DATA_EXT ".mfa"
+#define FRAME_ARCHIVE_INDEX_EXT ".mfi"
+
+struct FrameArchiveHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct FrameArchiveRecord {
+  uint32_t magic;
+  uint32_t size;
+  // save time (microseconds since the epoch, UTC)
+  int64_t time;
+};
+
+struct FrameArchiveEntry {
+  int64_t time;
+  // offset of the encoded image in the data file
+  uint64_t offset;
+  uint32_t size;
+  uint32_t reserved;
+};
+
+// Appends frames to a new archive. The files are never rewritten, so a
+// crash loses at most the frame being appended.
+class FrameArchiveWriter {
+private:
+  std::string path_;
+  int dataFd;
+  int indexFd;
+  uint64_t dataBytes;
+  size_t frames_;
+
+public:
+  // path of the data file; the index file takes FRAME_ARCHIVE_INDEX_EXT
+  explicit FrameArchiveWriter(const std::string &path);
+  ~FrameArchiveWriter();
+
+  const std::string &path() const;
+  uint64_t bytes() const;
+  size_t frames() const;
+
+  void append(int64_t time, const uint8_t *data, size_t size);
+};
+
+// Random access to an archive by timestamp through memory mappings. The
+// archive may still be growing; a reader sees the frames appended before it
+// was opened.
+class FrameArchiveReader {
+private:
+  std::string path_;
+  const uint8_t *data;
+  size_t dataBytes;
+  const FrameArchiveEntry *index;
+  size_t indexBytes;
+  size_t count;
+  // entries recovered from the record headers when the index is unusable
+  std::vector<FrameArchiveEntry> scanned;
+
+  void scan(size_t from);
+
+public:
+  explicit FrameArchiveReader(const std::string &path);
+  ~FrameArchiveReader();
+
+  const std::string &path() const;
+  size_t size() const;
+  const FrameArchiveEntry &entry(size_t i) const;
+  const uint8_t *frame(const FrameArchiveEntry &entry) const;
+
+  // the last frame saved at or before time, or the first frame if time
+  // precedes the archive; size() if the archive is empty
+  size_t find(int64_t time) const;
+};
+
+// path of the index file belonging to a data file
+std::string frame_archive_index_path(const std::string &dataPath);
+
+#endif /* D5F8316A_0B7C_4E29_A4D1_93C62E8B507F */
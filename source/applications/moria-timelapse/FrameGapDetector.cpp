@@ -0,0 +1,97 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FrameGapDetector.h"
+#include <algorithm>
+#include <cmath>
+
+// an interval this many times the nominal interval is a gap
+#define GAP_THRESHOLD 1.5
+// weight of each new interval in the nominal interval estimate
+#define INTERVAL_SMOOTHING 0.05
+// after this many consecutive gaps the frame rate is assumed to have changed
+#define RATE_CHANGE_GAPS 4
+
+FrameGapDetector::FrameGapDetector()
+    : lastSequence(-1), lastTimestamp(0), haveTimestamp(false), interval(0),
+      consecutiveGaps(0), dropped_(0), gaps_(0) {}
+
+int64_t FrameGapDetector::update(const FrameInfo &info) {
+  int64_t missed = 0;
+  int64_t timestamp = info.timestamp.count();
+
+  if (info.sequence >= 0 && lastSequence >= 0) {
+    missed = std::max<int64_t>(0, info.sequence - lastSequence - 1);
+    if (haveTimestamp && timestamp > lastTimestamp) {
+      // keep the interval estimate for resume()
+      double dt = static_cast<double>(timestamp - lastTimestamp) / (missed + 1);
+      interval = interval > 0 ? interval + (dt - interval) * INTERVAL_SMOOTHING
+                              : dt;
+    }
+  } else if (haveTimestamp && timestamp > lastTimestamp) {
+    double dt = static_cast<double>(timestamp - lastTimestamp);
+    if (interval > 0 && dt > GAP_THRESHOLD * interval &&
+        consecutiveGaps < RATE_CHANGE_GAPS) {
+      missed = std::llround(dt / interval) - 1;
+      consecutiveGaps++;
+    } else {
+      // a persistent change of interval is a new frame rate, not a gap
+      interval = (interval > 0 && consecutiveGaps < RATE_CHANGE_GAPS)
+                     ? interval + (dt - interval) * INTERVAL_SMOOTHING
+                     : dt;
+      consecutiveGaps = 0;
+    }
+  }
+
+  lastSequence = info.sequence;
+  lastTimestamp = timestamp;
+  haveTimestamp = timestamp > 0;
+
+  if (missed > 0) {
+    dropped_ += missed;
+    gaps_++;
+  }
+  return missed;
+}
+
+int64_t FrameGapDetector::resume(const FrameInfo &info,
+                                 std::chrono::nanoseconds outage) {
+  int64_t missed = 0;
+  if (interval > 0) {
+    missed = std::max<int64_t>(
+        0, std::llround(static_cast<double>(outage.count()) / interval) - 1);
+  }
+
+  reset();
+  lastSequence = info.sequence;
+  lastTimestamp = info.timestamp.count();
+  haveTimestamp = lastTimestamp > 0;
+
+  if (missed > 0) {
+    dropped_ += missed;
+    gaps_++;
+  }
+  return missed;
+}
+
+FrameGapDetector &FrameGapDetector::reset() {
+  lastSequence = -1;
+  haveTimestamp = false;
+  consecutiveGaps = 0;
+  return *this;
+}
+
+int64_t FrameGapDetector::dropped() const { return dropped_; }
+
+int64_t FrameGapDetector::gaps() const { return gaps_; }
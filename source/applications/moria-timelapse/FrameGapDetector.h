@@ -0,0 +1,49 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef D8A1F5C3_4B7E_4D29_9C06_2E8F1A7B5D92
+#define D8A1F5C3_4B7E_4D29_9C06_2E8F1A7B5D92
+
+#include "FrameSource.h"
+#include <chrono>
+#include <cstdint>
+
+// Detects frames lost between consecutive captures. Sequence numbers are
+// used when the source provides them; otherwise gaps are inferred from
+// timestamps against a running estimate of the nominal frame interval.
+class FrameGapDetector {
+private:
+  int64_t lastSequence;
+  int64_t lastTimestamp;
+  bool haveTimestamp;
+  double interval;
+  int consecutiveGaps;
+  int64_t dropped_;
+  int64_t gaps_;
+
+public:
+  FrameGapDetector();
+
+  // returns the number of frames lost immediately before info
+  int64_t update(const FrameInfo &info);
+  // first frame after the source was reopened; the outage is measured by
+  // the caller because the new source may number and time frames afresh
+  int64_t resume(const FrameInfo &info, std::chrono::nanoseconds outage);
+  FrameGapDetector &reset();
+
+  int64_t dropped() const;
+  int64_t gaps() const;
+};
+
+#endif /* D8A1F5C3_4B7E_4D29_9C06_2E8F1A7B5D92 */
@@ -0,0 +1,365 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef B7D2E9C4_1A3F_4B6E_8C5D_0F9A2E4B7C61
+#define B7D2E9C4_1A3F_4B6E_8C5D_0F9A2E4B7C61
+
+#include "BayerFormat.h"
+#include "IIR_2nd_temporal_filter.hpp"
+#include "InputConditioner.h"
+#include "MemoryUsage.h"
+#include "Trace.h"
+#include "butterworth_2nd_IIR_params.h"
+#include <algorithm>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+
+// Runtime interface to a temporal filter pipeline. The pipeline owns the
+// filter state and converts between capture frames and 8-bit or float output
+// frames.
+class FramePipeline {
+public:
+  enum Kind { MONO = 1, COLOR = 3, BAYER = 4, COLOR_YCRCB = 5 };
+
+  virtual ~FramePipeline() {}
+  virtual int channels() const = 0;
+  virtual Kind kind() const = 0;
+  virtual void apply(Butterworth2ndOrderIIRFilterParams<float> &params,
+                     const cv::Mat &frame) = 0;
+  // apply frame as the input for steps samples (steps > 1 after a gap)
+  virtual void advance(Butterworth2ndOrderIIRFilterParams<float> &params,
+                       const cv::Mat &frame, int64_t steps) = 0;
+  // reset the filter state to the most recent input frame
+  virtual void reset(const float &gain) = 0;
+  virtual void resetgain(const float &old_gain, const float &new_gain) = 0;
+  virtual void render(cv::Mat &out) = 0;
+  // render the filter output at full precision: a CV_32F BGR or grayscale
+  // frame with values in [0, 1]
+  virtual void renderFloat(cv::Mat &out) = 0;
+  // render 8-bit Y, Cr and Cb planes without an interleaved BGR frame;
+  // returns false unless the pipeline filters in YCrCb
+  virtual bool renderPlanes(cv::Mat *planes) {
+    (void)planes;
+    return false;
+  }
+
+  // 8-bit BGR or grayscale frame at most width wide (full size if width is
+  // 0), scaled down before the colour conversion where possible
+  virtual void renderPreview(cv::Mat &out, int width) = 0;
+
+  // CV_32F thumbnail of the filter output in [0, 1], one channel per
+  // filter channel, for cheap change detection without rendering the full
+  // frame
+  virtual void probe(cv::Mat &out, int width) = 0;
+
+  // add the buffers the pipeline allocates for capture frames like frame
+  virtual void memory(const cv::Mat &frame, MemoryUsage &usage) const = 0;
+
+  // filter state planes (4 per channel) for checkpoints; empty until the
+  // first frame has been applied
+  virtual std::vector<cv::Mat> state() const = 0;
+  virtual void restore(const std::vector<cv::Mat> &planes) = 0;
+
+  // select a pipeline matching the capture format of frame
+  static std::unique_ptr<FramePipeline>
+  create(const cv::Mat &frame, const BayerFormat &bayer,
+         const InputConditioner &conditioner, bool ycrcb);
+};
+
+template <int Channels> struct PipelineLayout;
+
+// luminance only; the capture plane is filtered directly
+template <> struct PipelineLayout<1> {
+  FramePipeline::Kind kind() const { return FramePipeline::MONO; }
+  void input(const cv::Mat &frame, double scale, cv::Mat *planes) {
+    frame.convertTo(planes[0], CV_32FC1, scale);
+  }
+  void inputFloat(const cv::Mat &frame, cv::Mat *planes) { planes[0] = frame; }
+  void output(const cv::Mat *values, cv::Mat &out) {
+    values[0].convertTo(out, CV_8UC1, 255.0);
+  }
+  void outputFloat(const cv::Mat *values, cv::Mat &out) {
+    values[0].copyTo(out);
+  }
+  bool outputPlanes(const cv::Mat *values, cv::Mat *planes) {
+    (void)values;
+    (void)planes;
+    return false;
+  }
+};
+
+// colour frames are filtered in XYZ space, or in YCrCb space when the
+// output is encoded from planes, one plane per channel
+template <> struct PipelineLayout<3> {
+  bool ycrcb;
+  int toFilter, fromFilter;
+  cv::Mat xyzFrame;
+  cv::Mat floatFrame;
+
+  explicit PipelineLayout(bool ycrcb = false)
+      : ycrcb(ycrcb),
+        toFilter(ycrcb ? cv::COLOR_BGR2YCrCb : cv::COLOR_RGB2XYZ),
+        fromFilter(ycrcb ? cv::COLOR_YCrCb2BGR : cv::COLOR_XYZ2RGB) {}
+
+  FramePipeline::Kind kind() const {
+    return ycrcb ? FramePipeline::COLOR_YCRCB : FramePipeline::COLOR;
+  }
+  void input(const cv::Mat &frame, double scale, cv::Mat *planes) {
+    cv::cvtColor(frame, xyzFrame, toFilter);
+    xyzFrame.convertTo(floatFrame, CV_32FC3, scale);
+    cv::split(floatFrame, planes);
+  }
+  void inputFloat(const cv::Mat &frame, cv::Mat *planes) {
+    cv::cvtColor(frame, floatFrame, toFilter);
+    cv::split(floatFrame, planes);
+  }
+  void output(const cv::Mat *values, cv::Mat &out) {
+    cv::merge(values, 3, floatFrame);
+    floatFrame.convertTo(out, CV_8UC3, 255.0);
+    cv::cvtColor(out, out, fromFilter);
+  }
+  void outputFloat(const cv::Mat *values, cv::Mat &out) {
+    cv::merge(values, 3, floatFrame);
+    cv::cvtColor(floatFrame, out, fromFilter);
+  }
+  bool outputPlanes(const cv::Mat *values, cv::Mat *planes) {
+    if (!ycrcb) {
+      return false;
+    }
+    for (int c = 0; c < 3; c++) {
+      values[c].convertTo(planes[c], CV_8UC1, 255.0);
+    }
+    return true;
+  }
+};
+
+template <int Channels> class TemporalPipeline : public FramePipeline {
+protected:
+  PipelineLayout<Channels> layout;
+  // separate conversion buffers, so previews do not resize the full ones
+  PipelineLayout<Channels> previewLayout;
+  InputConditioner conditioner;
+  IIR_2nd_temporal_filter<float> filter[Channels];
+  cv::Mat conditioned;
+  cv::Mat planes[Channels];
+  cv::Mat values[Channels];
+  cv::Mat preview[Channels];
+  // probe scratch; values[] may alias the filter state after render()
+  std::vector<cv::Mat> probePlanes;
+  double scale;
+
+public:
+  TemporalPipeline(
+      double scale, const InputConditioner &conditioner,
+      const PipelineLayout<Channels> &layout = PipelineLayout<Channels>())
+      : layout(layout), previewLayout(layout), conditioner(conditioner),
+        scale(scale) {}
+
+  int channels() const { return Channels; }
+
+  Kind kind() const { return layout.kind(); }
+
+  void apply(Butterworth2ndOrderIIRFilterParams<float> &params,
+             const cv::Mat &frame) {
+    advance(params, frame, 1);
+  }
+
+  void advance(Butterworth2ndOrderIIRFilterParams<float> &params,
+               const cv::Mat &frame, int64_t steps) {
+    {
+      TRACE_SCOPE("input convert");
+      if (conditioner.passthrough()) {
+        layout.input(frame, scale, planes);
+      } else {
+        // crop/bin and float conversion in one pass over the capture frame
+        conditioner.apply(frame, scale, conditioned);
+        layout.inputFloat(conditioned, planes);
+      }
+    }
+    for (int c = 0; c < Channels; c++) {
+      filter[c].advance(params, planes[c], steps);
+    }
+  }
+
+  void reset(const float &gain) {
+    for (int c = 0; c < Channels; c++) {
+      filter[c].reset(gain, planes[c]);
+    }
+  }
+
+  void resetgain(const float &old_gain, const float &new_gain) {
+    for (int c = 0; c < Channels; c++) {
+      filter[c].resetgain(old_gain, new_gain);
+    }
+  }
+
+  void render(cv::Mat &out) {
+    for (int c = 0; c < Channels; c++) {
+      values[c] = filter[c].value();
+    }
+    layout.output(values, out);
+  }
+
+  void renderFloat(cv::Mat &out) {
+    for (int c = 0; c < Channels; c++) {
+      values[c] = filter[c].value();
+    }
+    layout.outputFloat(values, out);
+  }
+
+  bool renderPlanes(cv::Mat *planes) {
+    for (int c = 0; c < Channels; c++) {
+      values[c] = filter[c].value();
+    }
+    return layout.outputPlanes(values, planes);
+  }
+
+  void renderPreview(cv::Mat &out, int width) {
+    const cv::Mat &first = filter[0].value();
+    if (width <= 0 || width >= first.cols) {
+      render(out);
+      return;
+    }
+    cv::Size size(width, std::max(1, first.rows * width / first.cols));
+    for (int c = 0; c < Channels; c++) {
+      cv::resize(filter[c].value(), preview[c], size, 0, 0, cv::INTER_AREA);
+    }
+    previewLayout.output(preview, out);
+  }
+
+  void probe(cv::Mat &out, int width) {
+    const cv::Mat &first = filter[0].value();
+    width = std::max(1, std::min(width, first.cols));
+    cv::Size size(width, std::max(1, first.rows * width / first.cols));
+    probePlanes.resize(Channels);
+    for (int c = 0; c < Channels; c++) {
+      cv::resize(filter[c].value(), probePlanes[c], size, 0, 0,
+                 cv::INTER_AREA);
+    }
+    cv::merge(probePlanes, out);
+  }
+
+  void memory(const cv::Mat &frame, MemoryUsage &usage) const {
+    cv::Size size = conditioner.outputSize(frame.size());
+    uint64_t area = static_cast<uint64_t>(size.area());
+    uint64_t plane = area * sizeof(float);
+    // X1, X2, Y1, Y2 of each channel
+    usage.add("filter state", 4 * Channels * plane);
+    // X0 and Y0 between samples, tempB and tempC when skipping ahead
+    usage.add("filter scratch", 4 * Channels * plane);
+    // float input planes; colour also has the interleaved float frame and,
+    // straight from the capture frame, the converted frame
+    uint64_t input = Channels * plane;
+    if (Channels > 1) {
+      input += Channels * plane;
+      if (conditioner.passthrough()) {
+        input += Channels * area * frame.elemSize1();
+      }
+    }
+    if (!conditioner.passthrough()) {
+      input += Channels * plane;
+    }
+    usage.add("input conversion", input);
+  }
+
+  std::vector<cv::Mat> state() const {
+    std::vector<cv::Mat> planes(4 * Channels);
+    for (int c = 0; c < Channels; c++) {
+      filter[c].state(&planes[4 * c]);
+    }
+    if (planes[0].empty()) {
+      planes.clear();
+    }
+    return planes;
+  }
+
+  void restore(const std::vector<cv::Mat> &planes) {
+    CV_Assert(planes.size() == 4 * Channels);
+    for (int c = 0; c < Channels; c++) {
+      filter[c].restore(&planes[4 * c]);
+    }
+  }
+};
+
+// raw Bayer frames are filtered as a single mosaic plane and demosaiced on
+// output
+class BayerPipeline : public TemporalPipeline<1> {
+private:
+  BayerFormat bayer;
+  cv::Mat mosaic;
+  cv::Mat mosaic16, bgr16;
+  cv::Mat demosaiced;
+
+public:
+  BayerPipeline(const BayerFormat &bayer, const InputConditioner &conditioner)
+      : TemporalPipeline<1>(bayer.scale(), conditioner), bayer(bayer) {}
+
+  Kind kind() const { return BAYER; }
+
+  bool renderPlanes(cv::Mat *planes) {
+    (void)planes;
+    return false;
+  }
+
+  void render(cv::Mat &out) {
+    TemporalPipeline<1>::render(mosaic);
+    bayer.demosaic(mosaic, out);
+  }
+
+  void memory(const cv::Mat &frame, MemoryUsage &usage) const {
+    TemporalPipeline<1>::memory(frame, usage);
+    // 8-bit mosaic, and the 16-bit mosaic and BGR frame for float output
+    uint64_t area =
+        static_cast<uint64_t>(conditioner.outputSize(frame.size()).area());
+    usage.add("output conversion", area + 2 * area + 6 * area);
+  }
+
+  // the mosaic cannot be scaled before demosaicing
+  void renderPreview(cv::Mat &out, int width) {
+    if (width <= 0 || width >= filter[0].value().cols) {
+      render(out);
+      return;
+    }
+    render(demosaiced);
+    int rows = std::max(1, demosaiced.rows * width / demosaiced.cols);
+    cv::resize(demosaiced, out, cv::Size(width, rows), 0, 0, cv::INTER_AREA);
+  }
+
+  // demosaic at 16 bits, which keeps the precision of the filter state
+  void renderFloat(cv::Mat &out) {
+    filter[0].value().convertTo(mosaic16, CV_16UC1, 65535.0);
+    bayer.demosaic(mosaic16, bgr16);
+    bgr16.convertTo(out, CV_32FC3, 1.0 / 65535.0);
+  }
+};
+
+inline std::unique_ptr<FramePipeline>
+FramePipeline::create(const cv::Mat &frame, const BayerFormat &bayer,
+                      const InputConditioner &conditioner, bool ycrcb) {
+  if (bayer.enabled()) {
+    return std::unique_ptr<FramePipeline>(
+        new BayerPipeline(bayer, conditioner));
+  }
+  double scale = frame.depth() == CV_16U ? 1.0 / 65535.0 : 1.0 / 255.0;
+  if (frame.channels() == 1) {
+    return std::unique_ptr<FramePipeline>(
+        new TemporalPipeline<1>(scale, conditioner));
+  }
+  return std::unique_ptr<FramePipeline>(
+      new TemporalPipeline<3>(scale, conditioner, PipelineLayout<3>(ycrcb)));
+}
+
+#endif /* B7D2E9C4_1A3F_4B6E_8C5D_0F9A2E4B7C61 */
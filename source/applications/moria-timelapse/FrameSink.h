@@ -0,0 +1,123 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef A0067AE3_7913_4B4B_9C93_2A7A5F0D48CD
+#define A0067AE3_7913_4B4B_9C93_2A7A5F0D48CD
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <opencv2/core.hpp>
+#include <sstream>
+#include <string>
+
+// Wall-clock time of a saved frame
+struct SaveTime {
+  std::chrono::system_clock::time_point time;
+  bool utc;
+
+  // format the save time, e.g. "%Y-%m-%d" for the per-day directory
+  std::string format(const char *fmt) const {
+    // reentrant conversions; several cameras may save at once
+    std::time_t t = std::chrono::system_clock::to_time_t(time);
+    std::tm calendar;
+    if (utc) {
+      gmtime_r(&t, &calendar);
+    } else {
+      localtime_r(&t, &calendar);
+    }
+    std::stringstream out;
+    out << std::put_time(&calendar, fmt);
+    return out.str();
+  }
+
+  // milliseconds past the second
+  int millis() const {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch());
+    return static_cast<int>(ms.count() % 1000);
+  }
+
+  // image file name without extension: YYYY-MM-DD_HH-MM-SS-<ms>
+  std::string stem() const {
+    std::stringstream name;
+    name << format("%Y-%m-%d_%H-%M-%S") << "-" << std::setw(3)
+         << std::setfill('0') << millis();
+    return name.str();
+  }
+};
+
+// Representations of the rendered output a sink can consume
+enum OutputFormat {
+  OUTPUT_BGR = 1,
+  OUTPUT_YCRCB = 2,
+  OUTPUT_FLOAT = 4,
+  OUTPUT_ALL = OUTPUT_BGR | OUTPUT_YCRCB | OUTPUT_FLOAT
+};
+
+// the format rendered for a sink accepting formats: full precision first,
+// then planes (which fall back to BGR if the pipeline cannot produce them)
+inline OutputFormat preferredFormat(int formats) {
+  if (formats & OUTPUT_FLOAT) {
+    return OUTPUT_FLOAT;
+  }
+  return (formats & OUTPUT_YCRCB) ? OUTPUT_YCRCB : OUTPUT_BGR;
+}
+
+// Rendered output frame, holding the preferred format of the sink it is
+// passed to:
+// - bgr: 8-bit BGR or grayscale frame
+// - ycrcb: full-resolution 8-bit Y, Cr and Cb planes
+// - bgrFloat: CV_32F BGR or grayscale frame in [0, 1], straight from the
+//   filter state
+struct OutputFrame {
+  cv::Mat bgr;
+  cv::Mat ycrcb[3];
+  cv::Mat bgrFloat;
+
+  bool hasPlanes() const { return !ycrcb[0].empty(); }
+};
+
+// Destination for the frames saved every save interval
+class FrameSink {
+public:
+  virtual ~FrameSink() {}
+
+  // OutputFormat flags this sink accepts
+  virtual int formats() const { return OUTPUT_BGR; }
+
+  // write the rendered output frame; returns the file written to, or an
+  // empty string if nothing was written synchronously
+  virtual std::string write(const OutputFrame &frame,
+                            const SaveTime &saved) = 0;
+
+  // finish any pending output
+  virtual void close() {}
+
+  // bytes written so far, read from the thread calling write
+  virtual uint64_t bytesWritten() const { return 0; }
+
+  // saved frames accepted but not yet written
+  virtual size_t queueDepth() const { return 0; }
+
+  // bytes of the buffers kept for output frames of size with channels
+  virtual uint64_t memory(cv::Size size, int channels) const {
+    (void)size;
+    (void)channels;
+    return 0;
+  }
+};
+
+#endif /* A0067AE3_7913_4B4B_9C93_2A7A5F0D48CD */
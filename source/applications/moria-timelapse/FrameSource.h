@@ -0,0 +1,51 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef A6C4E1F8_3D2B_4F7A_8B90_7E5D2C1A9F36
+#define A6C4E1F8_3D2B_4F7A_8B90_7E5D2C1A9F36
+
+#include <chrono>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+// Capture metadata delivered with each frame
+struct FrameInfo {
+  // driver or source sequence number; -1 if the source has none
+  int64_t sequence = -1;
+  // capture time on a monotonic clock
+  std::chrono::nanoseconds timestamp{0};
+  // frames lost immediately before this one (set by CameraManager)
+  int64_t dropped = 0;
+};
+
+// A source of frames for CameraManager: a camera, a synthetic generator or
+// a replay of recorded images.
+class FrameSource {
+public:
+  virtual ~FrameSource() {}
+  virtual bool isOpened() = 0;
+
+  // read the next frame. Returns false at the end of the stream; a source
+  // which is still running may return true with an empty frame.
+  virtual bool read(cv::Mat &frame, FrameInfo &info) = 0;
+
+  // set a capture property; returns false if unsupported by the source
+  virtual bool set(int prop, double value) {
+    (void)prop;
+    (void)value;
+    return false;
+  }
+};
+
+#endif /* A6C4E1F8_3D2B_4F7A_8B90_7E5D2C1A9F36 */
@@ -16,6 +16,10 @@
 #define A1D38A46_F2DF_4D0E_9162_CD837FD2E34F
 
 #include "butterworth_2nd_IIR_params.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <opencv2/core.hpp>
 
@@ -41,6 +45,35 @@ private:
     }
   }
 
+  // out = m^k for a 5x5 matrix
+  static void power(const double (&m)[5][5], int64_t k, double (&out)[5][5]) {
+    double base[5][5], tmp[5][5];
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < 5; j++) {
+        base[i][j] = m[i][j];
+        out[i][j] = i == j;
+      }
+    }
+    auto multiply = [&tmp](double(&a)[5][5], const double(&b)[5][5]) {
+      for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 5; j++) {
+          double sum = 0;
+          for (int n = 0; n < 5; n++) {
+            sum += a[i][n] * b[n][j];
+          }
+          tmp[i][j] = sum;
+        }
+      }
+      std::copy(&tmp[0][0], &tmp[0][0] + 25, &a[0][0]);
+    };
+    for (; k > 0; k >>= 1) {
+      if (k & 1) {
+        multiply(out, base);
+      }
+      multiply(base, base);
+    }
+  }
+
 public:
   IIR_2nd_temporal_filter() {}
   IIR_2nd_temporal_filter &apply(Butterworth2ndOrderIIRFilterParams<T> &params,
@@ -59,25 +92,83 @@ public:
     Y[1] = Y[2];
     Y[2] = tempY;
 
-    // apply input
+    // apply input and compute the output frame in one pass, split into row
+    // stripes on the worker pool shared by all cameras
+    CV_Assert(frame.depth() == cv::DataType<T>::depth);
     frame.copyTo(X[2]);
-    X[2] /= params.gain();
-
-    // compute output frame
-    Y[0].copyTo(tempB);
-    tempB *= params.B2();
-    Y[1].copyTo(tempC);
-    tempC *= params.B1();
-    X[1].copyTo(Y[2]);
-    Y[2] *= 2;
-    Y[2] += X[0];
-    Y[2] += X[2];
-    Y[2] += tempB;
-    Y[2] += tempC;
+    Y[2].create(X[2].size(), X[2].type());
+    const T inv_gain = T(1) / params.gain();
+    const T b1 = params.B1(), b2 = params.B2();
+    const int width = X[2].cols * X[2].channels();
+    const cv::Range rows(0, X[2].rows);
+    WorkerPool::parallel_for(rows, [&](const cv::Range &range) {
+      for (int row = range.start; row < range.end; row++) {
+        const T *x0 = X[0].template ptr<T>(row);
+        const T *x1 = X[1].template ptr<T>(row);
+        T *x2 = X[2].template ptr<T>(row);
+        const T *y0 = Y[0].template ptr<T>(row);
+        const T *y1 = Y[1].template ptr<T>(row);
+        T *y2 = Y[2].template ptr<T>(row);
+        for (int col = 0; col < width; col++) {
+          x2[col] *= inv_gain;
+          y2[col] = x0[col] + 2 * x1[col] + x2[col] + b2 * y0[col] +
+                    b1 * y1[col];
+        }
+      }
+    });
 
     return *this;
   }
 
+  // advance the filter by steps samples, holding frame as the input for the
+  // samples that were not captured. Beyond a couple of steps the held-input
+  // recursion is collapsed into one linear combination of the state planes.
+  IIR_2nd_temporal_filter &
+  advance(Butterworth2ndOrderIIRFilterParams<T> &params, const cv::Mat &frame,
+          int64_t steps) {
+    if (steps <= 2 || X[1].empty()) {
+      for (int64_t step = 0; step < steps; step++) {
+        apply(params, frame);
+      }
+      return *this;
+    }
+
+    // state (x1, x2, y1, y2) and held input u; one sample maps it to
+    // (x2, u, y2, x1 + 2 x2 + u + B2 y1 + B1 y2). The k-step coefficients
+    // are the k-th power of that map, found by repeated squaring so a long
+    // capture gap costs O(log k).
+    const double b1 = params.B1(), b2 = params.B2();
+    const double step[5][5] = {{0, 1, 0, 0, 0},
+                               {0, 0, 0, 0, 1},
+                               {0, 0, 0, 1, 0},
+                               {1, 2, b2, b1, 1},
+                               {0, 0, 0, 0, 1}};
+    double coef[5][5];
+    power(step, steps, coef);
+
+    // the input enters the state scaled by 1/gain
+    const cv::Mat in[5] = {X[1], X[2], Y[1], Y[2], frame};
+    const double inScale[5] = {1, 1, 1, 1, 1.0 / params.gain()};
+    cv::Mat out[4] = {X[0], Y[0], tempB, tempC};
+    for (int j = 0; j < 4; j++) {
+      in[0].convertTo(out[j], in[0].type(), coef[j][0]);
+      for (int i = 1; i < 5; i++) {
+        cv::scaleAdd(in[i], coef[j][i] * inScale[i], out[j], out[j]);
+      }
+    }
+
+    // recycle the old state buffers as scratch
+    X[0] = in[0];
+    Y[0] = in[2];
+    tempB = in[1];
+    tempC = in[3];
+    X[1] = out[0];
+    X[2] = out[1];
+    Y[1] = out[2];
+    Y[2] = out[3];
+    return *this;
+  }
+
   IIR_2nd_temporal_filter &reset(const T &gain, const cv::Mat &ref) {
     for (int idx = 1; idx < NZEROS + 1; idx++) {
       ref.copyTo(X[idx]);
@@ -102,6 +193,23 @@ public:
   }
 
   const cv::Mat &value() { return Y[2]; }
+
+  // the filter state: the two most recent inputs (scaled by 1/gain) and
+  // outputs. X[0] and Y[0] are only scratch between samples.
+  void state(cv::Mat planes[4]) const {
+    planes[0] = X[1];
+    planes[1] = X[2];
+    planes[2] = Y[1];
+    planes[3] = Y[2];
+  }
+
+  IIR_2nd_temporal_filter &restore(const cv::Mat planes[4]) {
+    planes[0].copyTo(X[1]);
+    planes[1].copyTo(X[2]);
+    planes[2].copyTo(Y[1]);
+    planes[3].copyTo(Y[2]);
+    return *this;
+  }
 };
 
 #endif /* A1D38A46_F2DF_4D0E_9162_CD837FD2E34F */
@@ -0,0 +1,67 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ImageDirectorySink.h"
+#include "Trace.h"
+#include "util.h"
+#include <iostream>
+#include <opencv2/core/utils/filesystem.hpp>
+
+#define ENDL "\n"
+
+ImageDirectorySink::ImageDirectorySink(std::shared_ptr<MoriaOptions> options)
+    : outDir(options->outDir()),
+      encoder(options->jpegQuality(), options->jpegSubsampling(),
+              options->jpegProgressive()),
+      bytes(0) {}
+
+ImageDirectorySink::~ImageDirectorySink() {}
+
+int ImageDirectorySink::formats() const { return OUTPUT_BGR | OUTPUT_YCRCB; }
+
+std::string ImageDirectorySink::write(const OutputFrame &frame,
+                                      const SaveTime &saved) {
+  if (!cv::utils::fs::exists(outDir) || !cv::utils::fs::isDirectory(outDir)) {
+    return std::string();
+  }
+
+  auto imgOutPath = cv::utils::fs::join(outDir, saved.format("%Y-%m-%d"));
+  auto imgOutFilePath = cv::utils::fs::join(imgOutPath, saved.stem() + ".jpg");
+
+  bool encoded;
+  {
+    TRACE_SCOPE("jpeg encode");
+    encoded = frame.hasPlanes() ? encoder.encodePlanes(frame.ycrcb)
+                                : encoder.encode(frame.bgr);
+  }
+  if (!encoded) {
+    std::cerr << "Warning: unable to encode image " << imgOutFilePath << ENDL;
+    return std::string();
+  }
+
+  TRACE_SCOPE("jpeg write");
+  cv::utils::fs::createDirectories(imgOutPath);
+  if (!write_file(imgOutFilePath, encoder.data())) {
+    std::cerr << "Warning: unable to write image " << imgOutFilePath << ENDL;
+    return std::string();
+  }
+  bytes += encoder.data().size();
+  return imgOutFilePath;
+}
+
+uint64_t ImageDirectorySink::bytesWritten() const { return bytes; }
+
+uint64_t ImageDirectorySink::memory(cv::Size size, int channels) const {
+  return JpegEncoder::memory(size, channels);
+}
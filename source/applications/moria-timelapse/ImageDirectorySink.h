@@ -0,0 +1,43 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EAF40027_F0BB_4E2C_8587_A96A8EC0C246
+#define EAF40027_F0BB_4E2C_8587_A96A8EC0C246
+
+#include "FrameSink.h"
+#include "JpegEncoder.h"
+#include "moria_options.h"
+#include <memory>
+#include <string>
+
+// Saves each frame as a JPEG image in a per-day directory:
+// <outDir>/<YYYY-MM-DD>/<YYYY-MM-DD_HH-MM-SS>-<ms>.jpg
+// Frames rendered as YCrCb planes are encoded without converting to BGR.
+class ImageDirectorySink : public FrameSink {
+private:
+  std::string outDir;
+  JpegEncoder encoder;
+  uint64_t bytes;
+
+public:
+  explicit ImageDirectorySink(std::shared_ptr<MoriaOptions> options);
+  virtual ~ImageDirectorySink();
+
+  virtual int formats() const;
+  virtual std::string write(const OutputFrame &frame, const SaveTime &saved);
+  virtual uint64_t bytesWritten() const;
+  virtual uint64_t memory(cv::Size size, int channels) const;
+};
+
+#endif /* EAF40027_F0BB_4E2C_8587_A96A8EC0C246 */
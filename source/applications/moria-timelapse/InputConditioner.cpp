@@ -0,0 +1,155 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "InputConditioner.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// sum bin x bin blocks of interleaved pixels
+template <typename T>
+static void bin_pixels(const cv::Mat &src, int bin, float scale,
+                       cv::Mat &dst) {
+  int cn = src.channels();
+  int width = dst.cols * cn;
+  const cv::Range rows(0, dst.rows);
+  WorkerPool::parallel_for(rows, [&](const cv::Range &range) {
+    std::vector<unsigned> acc(width);
+    for (int y = range.start; y < range.end; y++) {
+      std::fill(acc.begin(), acc.end(), 0u);
+      for (int k = 0; k < bin; k++) {
+        const T *s = src.ptr<T>(y * bin + k);
+        for (int x = 0; x < dst.cols; x++) {
+          for (int l = 0; l < bin; l++) {
+            const T *px = s + (x * bin + l) * cn;
+            for (int c = 0; c < cn; c++) {
+              acc[x * cn + c] += px[c];
+            }
+          }
+        }
+      }
+      float *d = dst.ptr<float>(y);
+      for (int i = 0; i < width; i++) {
+        d[i] = acc[i] * scale;
+      }
+    }
+  });
+}
+
+// sum bin x bin blocks of same-colour sites of a 2x2 Bayer mosaic
+template <typename T>
+static void bin_mosaic(const cv::Mat &src, int bin, float scale,
+                       cv::Mat &dst) {
+  const cv::Range rows(0, dst.rows);
+  WorkerPool::parallel_for(rows, [&](const cv::Range &range) {
+    std::vector<unsigned> acc(dst.cols);
+    for (int y = range.start; y < range.end; y++) {
+      std::fill(acc.begin(), acc.end(), 0u);
+      int row0 = (y >> 1) * bin * 2 + (y & 1);
+      for (int k = 0; k < bin; k++) {
+        const T *s = src.ptr<T>(row0 + k * 2);
+        for (int x = 0; x < dst.cols; x++) {
+          int col0 = (x >> 1) * bin * 2 + (x & 1);
+          for (int l = 0; l < bin; l++) {
+            acc[x] += s[col0 + l * 2];
+          }
+        }
+      }
+      float *d = dst.ptr<float>(y);
+      for (int x = 0; x < dst.cols; x++) {
+        d[x] = acc[x] * scale;
+      }
+    }
+  });
+}
+
+InputConditioner::InputConditioner(const std::string &roi, u_int bin,
+                                   bool mosaic)
+    : roi_(), bin_(static_cast<int>(bin)), mosaic_(mosaic) {
+  if (bin_ < 1 || bin_ > 8) {
+    std::stringstream errs;
+    errs << "Moria: Unsupported binning factor (" << bin << ")";
+    throw std::runtime_error(errs.str());
+  }
+  if (!roi.empty()) {
+    std::stringstream in(roi);
+    char sep[3];
+    in >> roi_.x >> sep[0] >> roi_.y >> sep[1] >> roi_.width >> sep[2] >>
+        roi_.height;
+    if (in.fail() || sep[0] != ',' || sep[1] != ',' || sep[2] != ',' ||
+        roi_.x < 0 || roi_.y < 0 || roi_.width <= 0 || roi_.height <= 0) {
+      std::stringstream errs;
+      errs << "Moria: Invalid region of interest (" << roi
+           << "); expected x,y,width,height";
+      throw std::runtime_error(errs.str());
+    }
+  }
+}
+
+bool InputConditioner::passthrough() const {
+  return bin_ == 1 && roi_.area() == 0;
+}
+
+int InputConditioner::bin() const { return bin_; }
+
+cv::Rect InputConditioner::clip(cv::Size input) const {
+  cv::Rect frame(0, 0, input.width, input.height);
+  cv::Rect r = roi_.area() > 0 ? (roi_ & frame) : frame;
+  int unit = bin_;
+  if (mosaic_) {
+    // keep the crop aligned to the 2x2 colour pattern
+    r.x &= ~1;
+    r.y &= ~1;
+    unit *= 2;
+  }
+  r.width -= r.width % unit;
+  r.height -= r.height % unit;
+  if (r.width <= 0 || r.height <= 0) {
+    throw std::runtime_error(
+        "Moria: Region of interest does not overlap the captured frame.");
+  }
+  return r;
+}
+
+cv::Size InputConditioner::outputSize(cv::Size input) const {
+  cv::Rect r = clip(input);
+  return cv::Size(r.width / bin_, r.height / bin_);
+}
+
+void InputConditioner::apply(const cv::Mat &frame, double scale,
+                             cv::Mat &out) const {
+  cv::Mat view = frame(clip(frame.size()));
+  int type = CV_32FC(frame.channels());
+  if (bin_ == 1) {
+    view.convertTo(out, type, scale);
+    return;
+  }
+
+  out.create(view.rows / bin_, view.cols / bin_, type);
+  float s = static_cast<float>(scale / (bin_ * bin_));
+  switch (frame.depth()) {
+  case CV_8U:
+    mosaic_ ? bin_mosaic<uchar>(view, bin_, s, out)
+            : bin_pixels<uchar>(view, bin_, s, out);
+    break;
+  case CV_16U:
+    mosaic_ ? bin_mosaic<ushort>(view, bin_, s, out)
+            : bin_pixels<ushort>(view, bin_, s, out);
+    break;
+  default:
+    throw std::runtime_error("Moria: Unsupported frame depth for binning.");
+  }
+}
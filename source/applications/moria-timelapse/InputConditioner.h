@@ -0,0 +1,48 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef D4F7A2B9_6E1C_4C83_A5D0_3B8E9F1C2A74
+#define D4F7A2B9_6E1C_4C83_A5D0_3B8E9F1C2A74
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <sys/types.h>
+
+// Crops and bins capture frames ahead of the filter. Cropping, binning and
+// the conversion to float are done in a single pass so the filter state and
+// all downstream work shrink with the conditioned frame.
+class InputConditioner {
+private:
+  cv::Rect roi_;
+  int bin_;
+  bool mosaic_;
+
+  cv::Rect clip(cv::Size input) const;
+
+public:
+  // roi is "x,y,width,height" (empty for the full frame); bin is the number
+  // of pixels combined along each axis. Mosaic frames are binned per colour
+  // site so the Bayer pattern is preserved.
+  InputConditioner(const std::string &roi, u_int bin, bool mosaic);
+
+  bool passthrough() const;
+  int bin() const;
+  cv::Size outputSize(cv::Size input) const;
+
+  // crop and bin an 8-bit or 16-bit frame into a float frame with the same
+  // number of channels; samples are averaged and multiplied by scale
+  void apply(const cv::Mat &frame, double scale, cv::Mat &out) const;
+};
+
+#endif /* D4F7A2B9_6E1C_4C83_A5D0_3B8E9F1C2A74 */
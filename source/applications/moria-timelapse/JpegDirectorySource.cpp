@@ -0,0 +1,133 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "JpegDirectorySource.h"
+#include "MjpegDecoder.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+// decoded frames buffered per worker thread
+#define PREFETCH_PER_WORKER 2
+
+JpegDirectorySource::JpegDirectorySource(
+    std::shared_ptr<MoriaOptions> options)
+    : scale(options->mjpegScale()),
+      fps(std::max(0.1f, options->captureFPS())), paced(!options->unpaced()),
+      depth(0), nextDecode(0), nextRead(0), stopping(false) {
+  std::string dir = options->replayDir();
+  if (!cv::utils::fs::isDirectory(dir)) {
+    std::stringstream errs;
+    errs << "Moria: Replay path is not a directory (" << dir << ")";
+    throw std::runtime_error(errs.str());
+  }
+  cv::utils::fs::glob(dir, "*.jpg", files, true);
+  std::sort(files.begin(), files.end());
+
+  // validates the scale before any worker starts
+  MjpegDecoder check(scale);
+  (void)check;
+
+  unsigned count =
+      std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+  depth = count * PREFETCH_PER_WORKER;
+  for (unsigned i = 0; i < count; i++) {
+    workers.push_back(std::thread(&JpegDirectorySource::decode_loop, this));
+  }
+
+  if (options->verbose()) {
+    std::cerr << "Replaying " << files.size() << " images from " << dir
+              << " using " << count << " decoder threads, "
+              << (paced ? "paced" : "unpaced") << ENDL;
+  }
+  start = std::chrono::steady_clock::now();
+}
+
+JpegDirectorySource::~JpegDirectorySource() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void JpegDirectorySource::decode_loop() {
+  MjpegDecoder decoder(scale);
+  std::vector<char> bytes;
+  for (;;) {
+    size_t idx;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      cond.wait(guard, [&]() {
+        return stopping ||
+               (nextDecode < files.size() && nextDecode < nextRead + depth);
+      });
+      if (stopping) {
+        return;
+      }
+      idx = nextDecode++;
+    }
+
+    cv::Mat frame;
+    std::ifstream in(files[idx], std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+    if (!bytes.empty()) {
+      decoder.decode(cv::Mat(1, static_cast<int>(bytes.size()), CV_8UC1,
+                             bytes.data()),
+                     frame);
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      ready[idx] = frame;
+    }
+    cond.notify_all();
+  }
+}
+
+bool JpegDirectorySource::isOpened() { return !files.empty(); }
+
+bool JpegDirectorySource::read(cv::Mat &frame, FrameInfo &info) {
+  if (nextRead >= files.size()) {
+    return false;
+  }
+
+  if (paced) {
+    auto due = start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::duration<double>(nextRead / fps));
+    std::this_thread::sleep_until(due);
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [&]() { return ready.count(nextRead) > 0; });
+    frame = ready[nextRead];
+    ready.erase(nextRead);
+    info.sequence = static_cast<int64_t>(nextRead);
+    info.timestamp = std::chrono::steady_clock::now().time_since_epoch();
+    nextRead++;
+  }
+  cond.notify_all();
+  return true;
+}
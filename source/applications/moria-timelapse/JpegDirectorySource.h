@@ -0,0 +1,58 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef B3F6D8A2_9C4E_4B1F_A6D7_8E2C5B9F1D04
+#define B3F6D8A2_9C4E_4B1F_A6D7_8E2C5B9F1D04
+
+#include "FrameSource.h"
+#include "moria_options.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Replays a directory tree of JPEG images (e.g. a previous moria output
+// directory) in file name order. Images are decoded ahead of time by a pool
+// of worker threads so decoding does not limit replay throughput.
+class JpegDirectorySource : public FrameSource {
+private:
+  std::vector<std::string> files;
+  u_int scale;
+  double fps;
+  bool paced;
+  size_t depth;
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable cond;
+  std::map<size_t, cv::Mat> ready;
+  size_t nextDecode;
+  size_t nextRead;
+  bool stopping;
+  std::chrono::steady_clock::time_point start;
+
+  void decode_loop();
+
+public:
+  explicit JpegDirectorySource(std::shared_ptr<MoriaOptions> options);
+  virtual ~JpegDirectorySource();
+
+  virtual bool isOpened();
+  virtual bool read(cv::Mat &frame, FrameInfo &info);
+};
+
+#endif /* B3F6D8A2_9C4E_4B1F_A6D7_8E2C5B9F1D04 */
@@ -0,0 +1,312 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "JpegEncoder.h"
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef MORIA_HAVE_LIBJPEG
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+
+// initial size of the output buffer; it grows to fit the largest image
+#define JPEG_BUFFER_SIZE 65536
+
+struct JpegEncoder::State {
+  struct ErrorManager {
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+  };
+
+  // writes into a growing buffer kept between images
+  struct Destination {
+    jpeg_destination_mgr pub;
+    std::vector<uchar> *buffer;
+  };
+
+  jpeg_compress_struct cinfo;
+  ErrorManager err;
+  Destination dest;
+  // prepared input: RGB without libjpeg-turbo, padded component planes for
+  // raw data (Y, Cb, Cr in JPEG order)
+  cv::Mat rgb;
+  cv::Mat planes[3];
+  cv::Mat chroma;
+
+  static void error_exit(j_common_ptr cinfo) {
+    ErrorManager *err = reinterpret_cast<ErrorManager *>(cinfo->err);
+    std::longjmp(err->jump, 1);
+  }
+
+  static void init_destination(j_compress_ptr cinfo) {
+    Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+    dest->buffer->resize(std::max<size_t>(dest->buffer->capacity(),
+                                          JPEG_BUFFER_SIZE));
+    dest->pub.next_output_byte = dest->buffer->data();
+    dest->pub.free_in_buffer = dest->buffer->size();
+  }
+
+  // called when the buffer is full: double it and carry on
+  static boolean empty_output_buffer(j_compress_ptr cinfo) {
+    Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+    size_t used = dest->buffer->size();
+    dest->buffer->resize(used * 2);
+    dest->pub.next_output_byte = dest->buffer->data() + used;
+    dest->pub.free_in_buffer = dest->buffer->size() - used;
+    return TRUE;
+  }
+
+  static void term_destination(j_compress_ptr cinfo) {
+    Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+    dest->buffer->resize(dest->buffer->size() - dest->pub.free_in_buffer);
+  }
+
+  State() {
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = error_exit;
+    jpeg_create_compress(&cinfo);
+    dest.pub.init_destination = init_destination;
+    dest.pub.empty_output_buffer = empty_output_buffer;
+    dest.pub.term_destination = term_destination;
+    dest.buffer = nullptr;
+    cinfo.dest = &dest.pub;
+  }
+
+  ~State() { jpeg_destroy_compress(&cinfo); }
+
+  static void sampling(int subsampling, int &h, int &v) {
+    h = subsampling == 444 ? 1 : 2;
+    v = subsampling == 420 ? 2 : 1;
+  }
+
+  void configure(int quality, int subsampling, bool progressive) {
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    if (cinfo.num_components == 3) {
+      int h, v;
+      sampling(subsampling, h, v);
+      cinfo.comp_info[0].h_samp_factor = h;
+      cinfo.comp_info[0].v_samp_factor = v;
+      for (int c = 1; c < 3; c++) {
+        cinfo.comp_info[c].h_samp_factor = 1;
+        cinfo.comp_info[c].v_samp_factor = 1;
+      }
+    }
+    if (progressive) {
+      jpeg_simple_progression(&cinfo);
+    }
+  }
+
+  // setjmp and longjmp must not skip destructors; encode and compressPlanes
+  // only use trivially destructible locals
+  bool encode(const cv::Mat &frame, int quality, int subsampling,
+              bool progressive, std::vector<uchar> &out) {
+    bool gray = frame.channels() == 1;
+#ifdef JCS_EXTENSIONS
+    const cv::Mat &in = frame;
+#else
+    if (!gray) {
+      cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+    }
+    const cv::Mat &in = gray ? frame : rgb;
+#endif
+    if (setjmp(err.jump)) {
+      jpeg_abort_compress(&cinfo);
+      return false;
+    }
+
+    dest.buffer = &out;
+    cinfo.image_width = static_cast<JDIMENSION>(in.cols);
+    cinfo.image_height = static_cast<JDIMENSION>(in.rows);
+    cinfo.input_components = gray ? 1 : 3;
+#ifdef JCS_EXTENSIONS
+    cinfo.in_color_space = gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+#else
+    cinfo.in_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+#endif
+    configure(quality, subsampling, progressive);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+      JSAMPROW row = const_cast<JSAMPROW>(
+          in.ptr<JSAMPLE>(static_cast<int>(cinfo.next_scanline)));
+      jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    return true;
+  }
+
+  // pad Y to whole MCUs and subsample the chroma planes to the JPEG
+  // component sizes
+  void preparePlanes(const cv::Mat *ycrcb, int subsampling) {
+    int h, v;
+    sampling(subsampling, h, v);
+    int mcuWidth = h * DCTSIZE, mcuHeight = v * DCTSIZE;
+    int cols = ycrcb[0].cols, rows = ycrcb[0].rows;
+    int paddedCols = (cols + mcuWidth - 1) / mcuWidth * mcuWidth;
+    int paddedRows = (rows + mcuHeight - 1) / mcuHeight * mcuHeight;
+
+    cv::copyMakeBorder(ycrcb[0], planes[0], 0, paddedRows - rows, 0,
+                       paddedCols - cols, cv::BORDER_REPLICATE);
+    cv::Size chromaSize((cols + h - 1) / h, (rows + v - 1) / v);
+    for (int c = 1; c < 3; c++) {
+      // JPEG orders the chroma components Cb, Cr
+      const cv::Mat &src = ycrcb[c == 1 ? 2 : 1];
+      if (h == 1 && v == 1) {
+        chroma = src;
+      } else {
+        cv::resize(src, chroma, chromaSize, 0, 0, cv::INTER_AREA);
+      }
+      cv::copyMakeBorder(chroma, planes[c], 0,
+                         paddedRows / v - chromaSize.height, 0,
+                         paddedCols / h - chromaSize.width,
+                         cv::BORDER_REPLICATE);
+    }
+  }
+
+  bool compressPlanes(int cols, int rows, int quality, int subsampling,
+                      bool progressive, std::vector<uchar> &out) {
+    JSAMPROW rowsY[2 * DCTSIZE], rowsCb[DCTSIZE], rowsCr[DCTSIZE];
+    JSAMPARRAY components[3] = {rowsY, rowsCb, rowsCr};
+
+    if (setjmp(err.jump)) {
+      jpeg_abort_compress(&cinfo);
+      return false;
+    }
+
+    dest.buffer = &out;
+    cinfo.image_width = static_cast<JDIMENSION>(cols);
+    cinfo.image_height = static_cast<JDIMENSION>(rows);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    configure(quality, subsampling, progressive);
+    // planes are already subsampled by preparePlanes
+    cinfo.raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+    cinfo.do_fancy_downsampling = FALSE;
+#endif
+    jpeg_start_compress(&cinfo, TRUE);
+
+    // one iMCU row per call: v * DCTSIZE luma rows, DCTSIZE chroma rows
+    int v = cinfo.comp_info[0].v_samp_factor;
+    int lines = v * DCTSIZE;
+    while (cinfo.next_scanline < cinfo.image_height) {
+      int row = static_cast<int>(cinfo.next_scanline);
+      for (int i = 0; i < lines; i++) {
+        rowsY[i] = planes[0].ptr<JSAMPLE>(row + i);
+      }
+      for (int i = 0; i < DCTSIZE; i++) {
+        rowsCb[i] = planes[1].ptr<JSAMPLE>(row / v + i);
+        rowsCr[i] = planes[2].ptr<JSAMPLE>(row / v + i);
+      }
+      jpeg_write_raw_data(&cinfo, components,
+                          static_cast<JDIMENSION>(lines));
+    }
+    jpeg_finish_compress(&cinfo);
+    return true;
+  }
+
+  bool encodePlanes(const cv::Mat *ycrcb, int quality, int subsampling,
+                    bool progressive, std::vector<uchar> &out) {
+    preparePlanes(ycrcb, subsampling);
+    return compressPlanes(ycrcb[0].cols, ycrcb[0].rows, quality, subsampling,
+                          progressive, out);
+  }
+};
+
+#else
+
+#include <opencv2/imgcodecs.hpp>
+
+// without libjpeg, fall back to OpenCV's encoder; planes are converted back
+// to BGR first
+struct JpegEncoder::State {
+  std::vector<int> params;
+  cv::Mat ycrcb, bgr;
+
+  bool encode(const cv::Mat &frame, int quality, int subsampling,
+              bool progressive, std::vector<uchar> &out) {
+    params.clear();
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(quality);
+    params.push_back(cv::IMWRITE_JPEG_PROGRESSIVE);
+    params.push_back(progressive ? 1 : 0);
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    params.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR);
+    int factor = cv::IMWRITE_JPEG_SAMPLING_FACTOR_420;
+    if (subsampling == 444) {
+      factor = cv::IMWRITE_JPEG_SAMPLING_FACTOR_444;
+    } else if (subsampling == 422) {
+      factor = cv::IMWRITE_JPEG_SAMPLING_FACTOR_422;
+    }
+    params.push_back(factor);
+#else
+    (void)subsampling;
+#endif
+    return cv::imencode(".jpg", frame, out, params);
+  }
+
+  bool encodePlanes(const cv::Mat *planes, int quality, int subsampling,
+                    bool progressive, std::vector<uchar> &out) {
+    cv::merge(planes, 3, ycrcb);
+    cv::cvtColor(ycrcb, bgr, cv::COLOR_YCrCb2BGR);
+    return encode(bgr, quality, subsampling, progressive, out);
+  }
+};
+
+#endif
+
+JpegEncoder::JpegEncoder(u_int quality, u_int subsampling, bool progressive)
+    : state(new State()), quality(static_cast<int>(quality)),
+      subsampling(static_cast<int>(subsampling)), progressive(progressive) {
+  if (quality < 1 || quality > 100) {
+    std::stringstream errs;
+    errs << "Moria: Unsupported JPEG quality (" << quality << ")";
+    throw std::runtime_error(errs.str());
+  }
+  if (subsampling != 420 && subsampling != 422 && subsampling != 444) {
+    std::stringstream errs;
+    errs << "Moria: Unsupported JPEG subsampling (" << subsampling << ")";
+    throw std::runtime_error(errs.str());
+  }
+}
+
+JpegEncoder::~JpegEncoder() {}
+
+bool JpegEncoder::encode(const cv::Mat &frame) {
+  if (frame.empty() || frame.depth() != CV_8U) {
+    return false;
+  }
+  return state->encode(frame, quality, subsampling, progressive, data_);
+}
+
+bool JpegEncoder::encodePlanes(const cv::Mat *ycrcb) {
+  if (ycrcb[0].empty() || ycrcb[0].type() != CV_8UC1) {
+    return false;
+  }
+  return state->encodePlanes(ycrcb, quality, subsampling, progressive,
+                             data_);
+}
+
+const std::vector<uchar> &JpegEncoder::data() const { return data_; }
+
+uint64_t JpegEncoder::memory(cv::Size size, int channels) {
+  uint64_t pixels = static_cast<uint64_t>(size.area()) * channels;
+  // padded planes or an RGB copy, and the compressed image (sized for about
+  // 2 bits per sample at high quality)
+  return pixels + pixels / 4;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef B7E41C52_3D90_4F6A_8A1E_6C2F95D0B318
+#define B7E41C52_3D90_4F6A_8A1E_6C2F95D0B318
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <sys/types.h>
+#include <vector>
+
+// Encodes JPEG images. When built with libjpeg(-turbo) a single compressor
+// and output buffer are reused for every image, and planar YCrCb frames are
+// encoded directly as raw component data without a colour conversion.
+class JpegEncoder {
+private:
+  struct State;
+  std::unique_ptr<State> state;
+  int quality;
+  int subsampling;
+  bool progressive;
+  std::vector<uchar> data_;
+
+public:
+  // quality 1-100; subsampling 420, 422 or 444
+  JpegEncoder(u_int quality, u_int subsampling, bool progressive);
+  ~JpegEncoder();
+
+  // encode an 8-bit BGR or grayscale frame into data(); returns false if the
+  // frame could not be encoded
+  bool encode(const cv::Mat &frame);
+
+  // encode full-resolution 8-bit Y, Cr and Cb planes into data()
+  bool encodePlanes(const cv::Mat *ycrcb);
+
+  // the last encoded image; valid until the next encode
+  const std::vector<uchar> &data() const;
+
+  // bytes of the conversion and output buffers for images of size
+  static uint64_t memory(cv::Size size, int channels);
+};
+
+#endif /* B7E41C52_3D90_4F6A_8A1E_6C2F95D0B318 */
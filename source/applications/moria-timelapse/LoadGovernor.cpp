@@ -0,0 +1,55 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "LoadGovernor.h"
+#include <algorithm>
+
+LoadGovernor::LoadGovernor(double targetLoad, u_int minDecimate,
+                           u_int maxDecimate)
+    : target(std::min(1.0, std::max(0.0, targetLoad))),
+      minDecimate(std::max(1u, minDecimate)),
+      maxDecimate(std::max(std::max(1u, minDecimate), maxDecimate)),
+      periodStart(std::chrono::steady_clock::now()), busyTime(0), dropped(0),
+      load_(0) {}
+
+void LoadGovernor::busy(std::chrono::nanoseconds elapsed) {
+  busyTime += elapsed;
+}
+
+u_int LoadGovernor::update(u_int decimate, int64_t lost) {
+  dropped += lost;
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - periodStart;
+  if (elapsed.count() < GOVERNOR_PERIOD) {
+    return decimate;
+  }
+  load_ = std::chrono::duration<double>(busyTime).count() / elapsed.count();
+  bool droppedFrames = dropped > 0;
+  periodStart = now;
+  busyTime = std::chrono::nanoseconds(0);
+  dropped = 0;
+
+  u_int next = decimate;
+  if (load_ > target || (droppedFrames && load_ > target * 0.9)) {
+    next = decimate + 1;
+  } else if (decimate > 1 && !droppedFrames) {
+    // processing scales with the filter samples: one in decimate frames
+    double predicted = load_ * decimate / (decimate - 1);
+    if (predicted < target * GOVERNOR_HYSTERESIS) {
+      next = decimate - 1;
+    }
+  }
+  return std::min(maxDecimate, std::max(minDecimate, next));
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef F2A96C3D_7E15_4B8A_9D40_C6E1B83F5A27
+#define F2A96C3D_7E15_4B8A_9D40_C6E1B83F5A27
+
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+
+// seconds of frames measured before each decision
+#define GOVERNOR_PERIOD 2
+// lower the decimation only if the load it would give stays this far below
+// the target
+#define GOVERNOR_HYSTERESIS 0.85
+
+// Adjusts the decimation to keep the share of time spent processing frames
+// (the load) at or below a target, leaving the rest as headroom. The load is
+// the processing time over the wall time of a period. Above the target, or
+// when the source drops frames while nearly at the target, the decimation
+// goes up by one; it comes down by one when the lower decimation is
+// predicted to stay clearly below the target.
+class LoadGovernor {
+private:
+  double target;
+  u_int minDecimate;
+  u_int maxDecimate;
+  std::chrono::steady_clock::time_point periodStart;
+  std::chrono::nanoseconds busyTime;
+  int64_t dropped;
+  double load_;
+
+public:
+  // targetLoad 0-1 (0 disables the governor); decimation stays within
+  // minDecimate and maxDecimate
+  LoadGovernor(double targetLoad, u_int minDecimate, u_int maxDecimate);
+
+  bool enabled() const { return target > 0; }
+
+  // add the time spent processing one frame
+  void busy(std::chrono::nanoseconds elapsed);
+
+  // call once per frame with the frames the source lost before it; returns
+  // the decimation to use from now on
+  u_int update(u_int decimate, int64_t lost);
+
+  // load of the last complete period
+  double load() const { return load_; }
+};
+
+#endif /* F2A96C3D_7E15_4B8A_9D40_C6E1B83F5A27 */
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "MemoryUsage.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+
+static std::atomic<uint64_t> reservedBytes(0);
+
+void MemoryUsage::add(const std::string &component, uint64_t bytes) {
+  auto entry = std::find_if(
+      components.begin(), components.end(),
+      [&](const std::pair<std::string, uint64_t> &c) {
+        return c.first == component;
+      });
+  if (entry == components.end()) {
+    components.emplace_back(component, bytes);
+  } else {
+    entry->second += bytes;
+  }
+}
+
+uint64_t MemoryUsage::total() const {
+  uint64_t sum = 0;
+  for (auto &component : components) {
+    sum += component.second;
+  }
+  return sum;
+}
+
+std::string MemoryUsage::format() const {
+  std::stringstream out;
+  out << format_mib(total()) << " (";
+  bool first = true;
+  for (auto &component : components) {
+    if (component.second == 0) {
+      continue;
+    }
+    out << (first ? "" : ", ") << component.first << ": "
+        << format_mib(component.second);
+    first = false;
+  }
+  out << ")";
+  return out.str();
+}
+
+std::string format_mib(uint64_t bytes) {
+  std::stringstream out;
+  out << std::fixed << std::setprecision(1)
+      << static_cast<double>(bytes) / (1 << 20) << " MiB";
+  return out.str();
+}
+
+bool MemoryBudget::reserve(uint64_t bytes, uint64_t budget) {
+  uint64_t reserved = reservedBytes.load();
+  do {
+    if (budget && reserved + bytes > budget) {
+      return false;
+    }
+  } while (!reservedBytes.compare_exchange_weak(reserved, reserved + bytes));
+  return true;
+}
+
+void MemoryBudget::release(uint64_t bytes) { reservedBytes -= bytes; }
+
+uint64_t MemoryBudget::reserved() { return reservedBytes.load(); }
@@ -0,0 +1,50 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef E8C4A27B_91D3_4F6E_B05A_3D72F18E6C94
+#define E8C4A27B_91D3_4F6E_B05A_3D72F18E6C94
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Bytes of the large frame buffers of one camera, by component. The sizes
+// are computed from the frame size before the buffers are allocated.
+struct MemoryUsage {
+  std::vector<std::pair<std::string, uint64_t>> components;
+
+  // add bytes to a component, creating it if needed
+  void add(const std::string &component, uint64_t bytes);
+  uint64_t total() const;
+  // e.g. "96.0 MiB (filter state: 64.0 MiB, ...)"
+  std::string format() const;
+};
+
+// format a byte count in MiB
+std::string format_mib(uint64_t bytes);
+
+// Process-wide budget shared by the frame buffers of all cameras
+class MemoryBudget {
+public:
+  // reserve bytes; returns false (reserving nothing) if the reserved total
+  // would exceed budget bytes. A budget of 0 is unlimited.
+  static bool reserve(uint64_t bytes, uint64_t budget);
+  static void release(uint64_t bytes);
+  // bytes reserved by all cameras
+  static uint64_t reserved();
+};
+
+#endif /* E8C4A27B_91D3_4F6E_B05A_3D72F18E6C94 */
@@ -0,0 +1,205 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MetricsExporter.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#define ENDL "\n"
+
+static std::string label(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+MetricsExporter::MetricsExporter(const std::string &path, double interval)
+    : path(path),
+      interval(static_cast<int64_t>(std::max(1.0, interval) * 1000)),
+      stopping(false) {
+  Tracer::enableStats();
+  worker = std::thread(&MetricsExporter::export_loop, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  worker.join();
+}
+
+std::shared_ptr<CameraMetrics>
+MetricsExporter::add(const std::string &camera) {
+  auto metrics = std::make_shared<CameraMetrics>(camera);
+  std::lock_guard<std::mutex> guard(lock);
+  cameras.push_back(metrics);
+  return metrics;
+}
+
+void MetricsExporter::export_loop() {
+  std::unique_lock<std::mutex> guard(lock);
+  for (;;) {
+    bool stop =
+        wake.wait_for(guard, interval, [this]() { return stopping; });
+    guard.unlock();
+    write();
+    guard.lock();
+    if (stop) {
+      break; // final values written
+    }
+  }
+}
+
+void MetricsExporter::write() {
+  std::vector<std::shared_ptr<CameraMetrics>> snapshot;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    snapshot = cameras;
+  }
+
+  std::stringstream out;
+  auto gauge = [&](const char *name, const char *help, const char *type,
+                   std::function<double(const CameraMetrics &)> value) {
+    out << "# HELP " << name << " " << help << ENDL;
+    out << "# TYPE " << name << " " << type << ENDL;
+    for (auto &camera : snapshot) {
+      out << name << "{camera=\"" << label(camera->camera) << "\"} "
+          << value(*camera) << ENDL;
+    }
+  };
+  gauge("moria_capture_fps", "Filter samples per second.", "gauge",
+        [](const CameraMetrics &m) { return m.fps.load(); });
+  out << "# HELP moria_frame_interval_seconds Interval between frames."
+      << ENDL;
+  out << "# TYPE moria_frame_interval_seconds gauge" << ENDL;
+  for (auto &camera : snapshot) {
+    std::string labels = "camera=\"" + label(camera->camera) + "\"";
+    out << "moria_frame_interval_seconds{" << labels << ",quantile=\"0.5\"} "
+        << camera->intervalP50 << ENDL;
+    out << "moria_frame_interval_seconds{" << labels
+        << ",quantile=\"0.99\"} " << camera->intervalP99 << ENDL;
+  }
+  gauge("moria_filter_samplerate_hz", "Sample rate of the temporal filter.",
+        "gauge", [](const CameraMetrics &m) { return m.samplerate.load(); });
+  gauge("moria_filter_gain", "Gain of the temporal filter.", "gauge",
+        [](const CameraMetrics &m) { return m.gain.load(); });
+  gauge("moria_decimate", "Captured frames per filter sample.", "gauge",
+        [](const CameraMetrics &m) {
+          return static_cast<double>(m.decimate.load());
+        });
+  gauge("moria_processing_load",
+        "Share of time spent processing frames (with --target-load).",
+        "gauge", [](const CameraMetrics &m) { return m.load.load(); });
+  gauge("moria_throughput_fps",
+        "Frames processed per second since the camera started.", "gauge",
+        [](const CameraMetrics &m) { return m.throughput.load(); });
+  gauge("moria_processing_seconds_total",
+        "Time spent processing frames, including the worker pool stripes "
+        "run for the camera.",
+        "counter", [](const CameraMetrics &m) {
+          return static_cast<double>(m.busy.load()) * 1e-9;
+        });
+  gauge("moria_frames_total", "Captured frames processed.", "counter",
+        [](const CameraMetrics &m) {
+          return static_cast<double>(m.frames.load());
+        });
+  gauge("moria_dropped_frames_total", "Frames lost by the capture source.",
+        "counter", [](const CameraMetrics &m) {
+          return static_cast<double>(m.dropped.load());
+        });
+  gauge("moria_reconnects_total", "Camera reconnects.", "counter",
+        [](const CameraMetrics &m) {
+          return static_cast<double>(m.reconnects.load());
+        });
+  gauge("moria_saves_total", "Frames saved.", "counter",
+        [](const CameraMetrics &m) {
+          return static_cast<double>(m.saves.load());
+        });
+  gauge("moria_skipped_saves_total", "Saves skipped as unchanged.", "counter",
+        [](const CameraMetrics &m) {
+          return static_cast<double>(m.skippedSaves.load());
+        });
+  gauge("moria_written_bytes_total", "Bytes written by the output sinks.",
+        "counter", [](const CameraMetrics &m) {
+          return static_cast<double>(m.bytesWritten.load());
+        });
+  gauge("moria_writer_queue_depth", "Saved frames waiting to be encoded.",
+        "gauge", [](const CameraMetrics &m) {
+          return static_cast<double>(m.queueDepth.load());
+        });
+
+  out << "# HELP moria_memory_bytes Frame buffer memory by component."
+      << ENDL;
+  out << "# TYPE moria_memory_bytes gauge" << ENDL;
+  for (auto &camera : snapshot) {
+    for (auto &component : camera->getMemory().components) {
+      out << "moria_memory_bytes{camera=\"" << label(camera->camera)
+          << "\",component=\"" << label(component.first) << "\"} "
+          << component.second << ENDL;
+    }
+  }
+
+  out << "# HELP moria_worker_threads Threads of the shared worker pool."
+      << ENDL;
+  out << "# TYPE moria_worker_threads gauge" << ENDL;
+  out << "moria_worker_threads " << WorkerPool::threads() << ENDL;
+
+  const double bounds[] = TRACE_STAGE_BOUNDS;
+  const char *histogram = "moria_stage_duration_seconds";
+  out << "# HELP " << histogram << " Duration of each processing stage."
+      << ENDL;
+  out << "# TYPE " << histogram << " histogram" << ENDL;
+  for (const StageStats &stats : Tracer::stageStats()) {
+    std::string labels = "thread=\"" + label(stats.thread) + "\",stage=\"" +
+                         label(stats.stage) + "\"";
+    uint64_t cumulative = 0;
+    for (int b = 0; b < TRACE_STAGE_BUCKETS; b++) {
+      cumulative += stats.buckets[b];
+      out << histogram << "_bucket{" << labels << ",le=\"";
+      if (b < TRACE_STAGE_BUCKETS - 1) {
+        out << bounds[b];
+      } else {
+        out << "+Inf";
+      }
+      out << "\"} " << cumulative << ENDL;
+    }
+    out << histogram << "_sum{" << labels << "} " << stats.sum << ENDL;
+    out << histogram << "_count{" << labels << "} " << stats.count << ENDL;
+  }
+
+  std::string tmp = path + ".tmp";
+  std::ofstream file(tmp);
+  file << out.str();
+  file.close();
+  if (!file || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::cerr << "Warning: unable to write metrics " << path << ENDL;
+  }
+}
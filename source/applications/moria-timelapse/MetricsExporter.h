@@ -0,0 +1,95 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef B49D2E17_6A0C_4F85_93E1_7C5B08D2F4A6
+#define B49D2E17_6A0C_4F85_93E1_7C5B08D2F4A6
+
+#include "MemoryUsage.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Current values of one camera; written by the camera thread, read by the
+// exporter
+struct CameraMetrics {
+  std::string camera;
+  std::atomic<double> fps{0};
+  std::atomic<double> samplerate{0};
+  std::atomic<double> gain{0};
+  // inter-frame interval percentiles (seconds)
+  std::atomic<double> intervalP50{0};
+  std::atomic<double> intervalP99{0};
+  std::atomic<int64_t> frames{0};
+  std::atomic<int64_t> dropped{0};
+  std::atomic<int64_t> reconnects{0};
+  std::atomic<int64_t> saves{0};
+  std::atomic<int64_t> skippedSaves{0};
+  std::atomic<int64_t> bytesWritten{0};
+  std::atomic<int64_t> queueDepth{0};
+  std::atomic<int64_t> decimate{1};
+  std::atomic<double> load{0};
+  // processed frames per second since the camera started
+  std::atomic<double> throughput{0};
+  // time spent processing frames (nanoseconds)
+  std::atomic<int64_t> busy{0};
+
+  explicit CameraMetrics(const std::string &camera) : camera(camera) {}
+
+  // frame buffer bytes by component
+  void setMemory(const MemoryUsage &usage) {
+    std::lock_guard<std::mutex> guard(memoryLock);
+    memory = usage;
+  }
+  MemoryUsage getMemory() {
+    std::lock_guard<std::mutex> guard(memoryLock);
+    return memory;
+  }
+
+private:
+  std::mutex memoryLock;
+  MemoryUsage memory;
+};
+
+// Periodically rewrites a Prometheus text-format file (for the node_exporter
+// textfile collector) with the metrics of every camera and the stage
+// duration histograms collected by Tracer. The file is replaced atomically.
+class MetricsExporter {
+private:
+  std::string path;
+  std::chrono::milliseconds interval;
+  std::vector<std::shared_ptr<CameraMetrics>> cameras;
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping;
+  std::thread worker;
+
+  void export_loop();
+  void write();
+
+public:
+  // interval in seconds
+  MetricsExporter(const std::string &path, double interval);
+  ~MetricsExporter();
+
+  // metrics of a camera, exported until the exporter is destroyed
+  std::shared_ptr<CameraMetrics> add(const std::string &camera);
+};
+
+#endif /* B49D2E17_6A0C_4F85_93E1_7C5B08D2F4A6 */
@@ -0,0 +1,142 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MjpegDecoder.h"
+#include "Trace.h"
+#include <sstream>
+#include <stdexcept>
+
+#ifdef MORIA_HAVE_LIBJPEG
+
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#include <opencv2/imgproc.hpp>
+
+struct MjpegDecoder::State {
+  struct ErrorManager {
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+  };
+
+  jpeg_decompress_struct dinfo;
+  ErrorManager err;
+  cv::Mat rgb;
+
+  // libjpeg's default handler calls exit(); unwind to decode() instead
+  static void error_exit(j_common_ptr cinfo) {
+    ErrorManager *err = reinterpret_cast<ErrorManager *>(cinfo->err);
+    std::longjmp(err->jump, 1);
+  }
+
+  // corrupt-data warnings are common on MJPEG streams; stay quiet
+  static void output_message(j_common_ptr) {}
+
+  State() {
+    dinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = error_exit;
+    err.pub.output_message = output_message;
+    jpeg_create_decompress(&dinfo);
+  }
+
+  ~State() { jpeg_destroy_decompress(&dinfo); }
+
+  // setjmp and longjmp must not skip destructors; this function only uses
+  // trivially destructible locals
+  bool decode(const cv::Mat &jpeg, int scale, cv::Mat &frame) {
+    if (setjmp(err.jump)) {
+      jpeg_abort_decompress(&dinfo);
+      return false;
+    }
+
+    jpeg_mem_src(&dinfo, jpeg.data,
+                 static_cast<unsigned long>(jpeg.total() * jpeg.elemSize()));
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = static_cast<unsigned int>(scale);
+    bool gray = dinfo.num_components == 1;
+#ifdef JCS_EXTENSIONS
+    dinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+    cv::Mat &out = frame;
+#else
+    dinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    cv::Mat &out = gray ? frame : rgb;
+#endif
+    jpeg_start_decompress(&dinfo);
+
+    out.create(static_cast<int>(dinfo.output_height),
+               static_cast<int>(dinfo.output_width), gray ? CV_8UC1 : CV_8UC3);
+    while (dinfo.output_scanline < dinfo.output_height) {
+      JSAMPROW row = out.ptr<JSAMPLE>(static_cast<int>(dinfo.output_scanline));
+      jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dinfo);
+
+#ifndef JCS_EXTENSIONS
+    if (!gray) {
+      cv::cvtColor(rgb, frame, cv::COLOR_RGB2BGR);
+    }
+#endif
+    return true;
+  }
+};
+
+#else
+
+#include <opencv2/imgcodecs.hpp>
+
+// without libjpeg, fall back to OpenCV's reduced-size decode
+struct MjpegDecoder::State {
+  bool decode(const cv::Mat &jpeg, int scale, cv::Mat &frame) {
+    int flags = cv::IMREAD_COLOR;
+    switch (scale) {
+    case 2:
+      flags = cv::IMREAD_REDUCED_COLOR_2;
+      break;
+    case 4:
+      flags = cv::IMREAD_REDUCED_COLOR_4;
+      break;
+    case 8:
+      flags = cv::IMREAD_REDUCED_COLOR_8;
+      break;
+    default:
+      break;
+    }
+    frame = cv::imdecode(jpeg, flags);
+    return !frame.empty();
+  }
+};
+
+#endif
+
+MjpegDecoder::MjpegDecoder(u_int scale)
+    : state(new State()), scale_(static_cast<int>(scale)) {
+  if (scale_ != 1 && scale_ != 2 && scale_ != 4 && scale_ != 8) {
+    std::stringstream errs;
+    errs << "Moria: Unsupported MJPEG decode scale (" << scale << ")";
+    throw std::runtime_error(errs.str());
+  }
+}
+
+MjpegDecoder::~MjpegDecoder() {}
+
+int MjpegDecoder::scale() const { return scale_; }
+
+bool MjpegDecoder::decode(const cv::Mat &jpeg, cv::Mat &frame) {
+  if (jpeg.empty()) {
+    return false;
+  }
+  TRACE_SCOPE("mjpeg decode");
+  return state->decode(jpeg, scale_, frame);
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef F2A8C3D1_7B4E_4A95_9E62_5C1D8B3F0A47
+#define F2A8C3D1_7B4E_4A95_9E62_5C1D8B3F0A47
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <sys/types.h>
+
+// Decodes compressed MJPEG frames. When built with libjpeg(-turbo) a single
+// decompressor is reused for every frame and frames are decoded directly at
+// 1/scale resolution using DCT scaling.
+class MjpegDecoder {
+private:
+  struct State;
+  std::unique_ptr<State> state;
+  int scale_;
+
+public:
+  // scale must be 1, 2, 4 or 8
+  explicit MjpegDecoder(u_int scale);
+  ~MjpegDecoder();
+
+  int scale() const;
+
+  // decode a compressed frame into an 8-bit BGR or grayscale frame; returns
+  // false if the data could not be decoded
+  bool decode(const cv::Mat &jpeg, cv::Mat &frame);
+};
+
+#endif /* F2A8C3D1_7B4E_4A95_9E62_5C1D8B3F0A47 */
@@ -0,0 +1,111 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PreciseImageSink.h"
+#include "Trace.h"
+#include "util.h"
+#include <algorithm>
+#include <iostream>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+// libtiff compression schemes
+#define TIFF_COMPRESSION_NONE 1
+#define TIFF_COMPRESSION_LZW 5
+
+PreciseImageSink::PreciseImageSink(std::shared_ptr<MoriaOptions> options)
+    : outDir(options->outDir()), bytes(0) {
+  std::string format = options->saveFloat();
+  int compression =
+      static_cast<int>(std::min(9u, options->floatCompression()));
+  // favour encode speed: a full-size 16-bit frame at zlib level 9 can take
+  // longer than the save interval
+  if (format == "png") {
+    extension = ".png";
+    params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    params.push_back(compression);
+  } else if (format == "tiff" || format == "tif") {
+    extension = ".tiff";
+    params.push_back(cv::IMWRITE_TIFF_COMPRESSION);
+    params.push_back(compression ? TIFF_COMPRESSION_LZW
+                                 : TIFF_COMPRESSION_NONE);
+  } else if (format == "exr") {
+    extension = ".exr";
+    params.push_back(cv::IMWRITE_EXR_TYPE);
+    params.push_back(cv::IMWRITE_EXR_TYPE_HALF);
+#if CV_VERSION_MAJOR > 4 ||                                                    \
+    (CV_VERSION_MAJOR == 4 &&                                                  \
+     (CV_VERSION_MINOR > 5 ||                                                  \
+      (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 1)))
+    params.push_back(cv::IMWRITE_EXR_COMPRESSION);
+    params.push_back(compression ? cv::IMWRITE_EXR_COMPRESSION_PIZ
+                                 : cv::IMWRITE_EXR_COMPRESSION_NO);
+#endif
+  } else {
+    throw std::runtime_error("Moria: Unsupported full-precision format (" +
+                             format + ")");
+  }
+}
+
+PreciseImageSink::~PreciseImageSink() {}
+
+int PreciseImageSink::formats() const { return OUTPUT_FLOAT; }
+
+std::string PreciseImageSink::write(const OutputFrame &frame,
+                                    const SaveTime &saved) {
+  if (frame.bgrFloat.empty() || !cv::utils::fs::exists(outDir) ||
+      !cv::utils::fs::isDirectory(outDir)) {
+    return std::string();
+  }
+
+  auto imgOutPath = cv::utils::fs::join(outDir, saved.format("%Y-%m-%d"));
+  auto imgOutFilePath =
+      cv::utils::fs::join(imgOutPath, saved.stem() + extension);
+  cv::utils::fs::createDirectories(imgOutPath);
+
+  TRACE_SCOPE("float image write");
+  // EXR takes the float frame as is; PNG and TIFF are scaled to 16 bits
+  const cv::Mat *out = &frame.bgrFloat;
+  if (extension != ".exr") {
+    frame.bgrFloat.convertTo(frame16, CV_16U, 65535.0);
+    out = &frame16;
+  }
+  try {
+    // encoded in memory to account for the bytes written
+    if (!cv::imencode(extension, *out, data, params) ||
+        !write_file(imgOutFilePath, data)) {
+      std::cerr << "Warning: unable to write image " << imgOutFilePath
+                << ENDL;
+      return std::string();
+    }
+  } catch (const cv::Exception &ex) {
+    // e.g. OpenEXR disabled at runtime (OPENCV_IO_ENABLE_OPENEXR)
+    std::cerr << "Warning: unable to write image " << imgOutFilePath << ": "
+              << ex.what() << ENDL;
+    return std::string();
+  }
+  bytes += data.size();
+  return imgOutFilePath;
+}
+
+uint64_t PreciseImageSink::bytesWritten() const { return bytes; }
+
+uint64_t PreciseImageSink::memory(cv::Size size, int channels) const {
+  // 16-bit frame and the encoded image (at most about as large)
+  uint64_t samples = static_cast<uint64_t>(size.area()) * channels;
+  return extension == ".exr" ? 2 * samples : 4 * samples;
+}
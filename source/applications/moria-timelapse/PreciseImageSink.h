@@ -0,0 +1,48 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef C94A0E7B_61F2_4D38_B5A3_0E8D27F4C196
+#define C94A0E7B_61F2_4D38_B5A3_0E8D27F4C196
+
+#include "FrameSink.h"
+#include "moria_options.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Saves the filter output at full precision next to the JPEG images:
+// <outDir>/<YYYY-MM-DD>/<YYYY-MM-DD_HH-MM-SS>-<ms>.{png,tiff,exr}
+// PNG and TIFF images are 16 bits per channel, EXR images are half float.
+// Frames are rendered straight from the float filter state, so the
+// precision gained by long virtual exposures is kept.
+class PreciseImageSink : public FrameSink {
+private:
+  std::string outDir;
+  std::string extension;
+  std::vector<int> params;
+  cv::Mat frame16;
+  std::vector<uchar> data;
+  uint64_t bytes;
+
+public:
+  explicit PreciseImageSink(std::shared_ptr<MoriaOptions> options);
+  virtual ~PreciseImageSink();
+
+  virtual int formats() const;
+  virtual std::string write(const OutputFrame &frame, const SaveTime &saved);
+  virtual uint64_t bytesWritten() const;
+  virtual uint64_t memory(cv::Size size, int channels) const;
+};
+
+#endif /* C94A0E7B_61F2_4D38_B5A3_0E8D27F4C196 */
@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "PreviewWindow.h"
+#include "Trace.h"
+#include <opencv2/highgui.hpp>
+
+PreviewWindow::PreviewWindow(const std::string &name)
+    : name(name), fresh(false), closing(false) {}
+
+PreviewWindow::~PreviewWindow() {}
+
+void PreviewWindow::run() {
+  if (Tracer::enabled()) {
+    Tracer::nameThread("ui");
+  }
+  std::unique_lock<std::mutex> guard(lock);
+  while (!closing) {
+    if (fresh) {
+      std::swap(latest, shown);
+      fresh = false;
+      guard.unlock();
+      TRACE_SCOPE("display");
+      cv::imshow(name, shown);
+    } else {
+      guard.unlock();
+    }
+    // also processes the window events
+    int key = cv::waitKey(PREVIEW_EVENT_WAIT);
+    // the user quit, even if the capture thread cannot take the key now
+    bool quit = key == 'q' ||
+                (!shown.empty() &&
+                 cv::getWindowProperty(name, cv::WND_PROP_VISIBLE) < 1);
+    guard.lock();
+    if (key >= 0) {
+      keys.push_back(key);
+    }
+    if (quit) {
+      break;
+    }
+  }
+  guard.unlock();
+  if (!shown.empty()) {
+    cv::destroyWindow(name);
+  }
+}
+
+void PreviewWindow::close() {
+  std::lock_guard<std::mutex> guard(lock);
+  closing = true;
+}
+
+void PreviewWindow::post(const cv::Mat &frame) {
+  // copy outside the lock; spare is only touched by the posting thread
+  frame.copyTo(spare);
+  std::lock_guard<std::mutex> guard(lock);
+  std::swap(spare, latest);
+  fresh = true;
+}
+
+bool PreviewWindow::nextKey(int &key) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (keys.empty()) {
+    return false;
+  }
+  key = keys.front();
+  keys.pop_front();
+  return true;
+}
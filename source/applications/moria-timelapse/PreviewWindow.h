@@ -0,0 +1,60 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef A7D35E90_4C1B_4F28_8E6A_2B94C07F1D53
+#define A7D35E90_4C1B_4F28_8E6A_2B94C07F1D53
+
+#include <deque>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <string>
+
+// milliseconds the UI thread waits for window events per iteration
+#define PREVIEW_EVENT_WAIT 10
+
+// Live preview window driven by its own thread, so drawing and window
+// events never block the capture thread. The capture thread posts frames
+// into a single-slot mailbox (only the latest frame is shown) and reads the
+// keys pressed from a queue. All highgui calls are made by the thread that
+// calls run().
+class PreviewWindow {
+private:
+  std::string name;
+  std::mutex lock;
+  // triple buffer: filled by post, waiting in the mailbox, being shown
+  cv::Mat spare, latest, shown;
+  bool fresh;
+  std::deque<int> keys;
+  bool closing;
+
+public:
+  explicit PreviewWindow(const std::string &name);
+  ~PreviewWindow();
+
+  // show frames and collect keys until close(), the 'q' key or the window
+  // is closed; call from the UI thread
+  void run();
+
+  // stop run()
+  void close();
+
+  // replace the frame waiting to be shown with a copy of frame
+  void post(const cv::Mat &frame);
+
+  // next key pressed in the window; false if there is none
+  bool nextKey(int &key);
+};
+
+#endif /* A7D35E90_4C1B_4F28_8E6A_2B94C07F1D53 */
@@ -0,0 +1,149 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyramidSink.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+#include "util.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+PyramidSink::PyramidSink(std::shared_ptr<MoriaOptions> options)
+    : outDir(options->outDir()), bytes(0) {
+  for (const std::string &spec : options->outputSizes()) {
+    // name:width
+    size_t colon = spec.find(':');
+    Level level;
+    level.name = spec.substr(0, colon);
+    level.width = 0;
+    if (colon != std::string::npos) {
+      std::stringstream width(spec.substr(colon + 1));
+      width >> level.width;
+    }
+    if (level.name.empty() || level.width <= 0 ||
+        level.name.find('/') != std::string::npos) {
+      throw std::runtime_error("Moria: Invalid output size (" + spec +
+                               "); expected name:width");
+    }
+    level.encoder.reset(new JpegEncoder(options->jpegQuality(),
+                                        options->jpegSubsampling(),
+                                        options->jpegProgressive()));
+    level.written = false;
+    levels.push_back(std::move(level));
+  }
+  // largest first, so each level is downsampled from the one before
+  std::sort(levels.begin(), levels.end(),
+            [](const Level &a, const Level &b) { return a.width > b.width; });
+}
+
+PyramidSink::~PyramidSink() {}
+
+int PyramidSink::formats() const { return OUTPUT_BGR | OUTPUT_YCRCB; }
+
+void PyramidSink::downsample(const OutputFrame &from, Level &level) {
+  const cv::Mat &first = from.hasPlanes() ? from.ycrcb[0] : from.bgr;
+  // never upscale: a level wider than its source keeps the source size
+  int width = std::min(level.width, first.cols);
+  int height = static_cast<int>(
+      std::lround(static_cast<double>(first.rows) * width / first.cols));
+  cv::Size size(width, std::max(1, height));
+  if (from.hasPlanes()) {
+    level.frame.bgr.release();
+    for (int c = 0; c < 3; c++) {
+      cv::resize(from.ycrcb[c], level.frame.ycrcb[c], size, 0, 0,
+                 cv::INTER_AREA);
+    }
+  } else {
+    for (int c = 0; c < 3; c++) {
+      level.frame.ycrcb[c].release();
+    }
+    cv::resize(from.bgr, level.frame.bgr, size, 0, 0, cv::INTER_AREA);
+  }
+}
+
+std::string PyramidSink::write(const OutputFrame &frame,
+                               const SaveTime &saved) {
+  if (levels.empty() || (frame.bgr.empty() && !frame.hasPlanes())) {
+    return std::string();
+  }
+
+  {
+    // chained area downsampling, largest level first
+    TRACE_SCOPE("pyramid downsample");
+    const OutputFrame *from = &frame;
+    for (Level &level : levels) {
+      downsample(*from, level);
+      from = &level.frame;
+    }
+  }
+
+  std::string day = saved.format("%Y-%m-%d");
+  std::string name = saved.stem() + ".jpg";
+  for (Level &level : levels) {
+    std::string dir = cv::utils::fs::join(outDir, level.name);
+    dir = cv::utils::fs::join(dir, day);
+    cv::utils::fs::createDirectories(dir);
+    level.path = cv::utils::fs::join(dir, name);
+  }
+
+  // each level has its own encoder, so the levels encode independently
+  WorkerPool::parallel_for(
+      cv::Range(0, static_cast<int>(levels.size())),
+      [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+          TRACE_SCOPE("pyramid encode");
+          Level &level = levels[static_cast<size_t>(i)];
+          bool encoded = level.frame.hasPlanes()
+                             ? level.encoder->encodePlanes(level.frame.ycrcb)
+                             : level.encoder->encode(level.frame.bgr);
+          level.written =
+              encoded && write_file(level.path, level.encoder->data());
+        }
+      });
+
+  std::string written;
+  for (Level &level : levels) {
+    if (!level.written) {
+      std::cerr << "Warning: unable to write image " << level.path << ENDL;
+      continue;
+    }
+    bytes += level.encoder->data().size();
+    if (written.empty()) {
+      written = level.path;
+    }
+  }
+  return written;
+}
+
+uint64_t PyramidSink::bytesWritten() const { return bytes; }
+
+uint64_t PyramidSink::memory(cv::Size size, int channels) const {
+  uint64_t bytes = 0;
+  for (const Level &level : levels) {
+    // downsampled frame and its encoder
+    int width = std::min(level.width, size.width);
+    cv::Size levelSize(width, static_cast<int>(static_cast<int64_t>(
+                                  size.height) * width / size.width));
+    bytes += static_cast<uint64_t>(levelSize.area()) * channels +
+             JpegEncoder::memory(levelSize, channels);
+  }
+  return bytes;
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef F61B0D94_7C2E_4A53_B8F6_2E9A4C71D035
+#define F61B0D94_7C2E_4A53_B8F6_2E9A4C71D035
+
+#include "FrameSink.h"
+#include "JpegEncoder.h"
+#include "moria_options.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Saves reduced-size copies of each frame, one tree per level:
+// <outDir>/<name>/<YYYY-MM-DD>/<YYYY-MM-DD_HH-MM-SS>-<ms>.jpg
+// Levels are given as name:width and produced largest first, each
+// area-downsampled from the previous level; the levels are then encoded in
+// parallel. Frames rendered as YCrCb planes stay planar throughout.
+class PyramidSink : public FrameSink {
+private:
+  struct Level {
+    std::string name;
+    int width;
+    std::unique_ptr<JpegEncoder> encoder;
+    OutputFrame frame;
+    std::string path;
+    bool written;
+  };
+
+  std::string outDir;
+  std::vector<Level> levels;
+  uint64_t bytes;
+
+  void downsample(const OutputFrame &from, Level &level);
+
+public:
+  explicit PyramidSink(std::shared_ptr<MoriaOptions> options);
+  virtual ~PyramidSink();
+
+  virtual int formats() const;
+  virtual std::string write(const OutputFrame &frame, const SaveTime &saved);
+  virtual uint64_t bytesWritten() const;
+  virtual uint64_t memory(cv::Size size, int channels) const;
+};
+
+#endif /* F61B0D94_7C2E_4A53_B8F6_2E9A4C71D035 */
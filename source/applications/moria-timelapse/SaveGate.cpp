@@ -0,0 +1,51 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SaveGate.h"
+#include <algorithm>
+
+SaveGate::SaveGate(double threshold, double maxSkip)
+    : threshold(threshold),
+      maxSkip(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(std::max(0.0, maxSkip)))),
+      difference_(0), skipped_(0) {}
+
+bool SaveGate::enabled() const { return threshold > 0; }
+
+bool SaveGate::admit(const cv::Mat &probe) {
+  auto now = std::chrono::steady_clock::now();
+  bool comparable = !last.empty() && last.size() == probe.size() &&
+                    last.type() == probe.type();
+  if (comparable) {
+    // per channel, so opposite chroma shifts do not cancel out; probes are
+    // in [0, 1], reported in 8-bit levels
+    cv::absdiff(probe, last, diff);
+    cv::Scalar mean = cv::mean(diff);
+    difference_ = 0;
+    for (int c = 0; c < probe.channels(); c++) {
+      difference_ = std::max(difference_, mean[c] * 255.0);
+    }
+    if (difference_ < threshold && now - lastSaved < maxSkip) {
+      skipped_++;
+      return false;
+    }
+  }
+  probe.copyTo(last);
+  lastSaved = now;
+  return true;
+}
+
+double SaveGate::difference() const { return difference_; }
+
+int64_t SaveGate::skipped() const { return skipped_; }
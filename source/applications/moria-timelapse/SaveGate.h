@@ -0,0 +1,56 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef A8C3E6F1_92B4_4D07_8E5A_3F1B7D20C964
+#define A8C3E6F1_92B4_4D07_8E5A_3F1B7D20C964
+
+#include <chrono>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+// width of the probe frames compared by SaveGate
+#define SAVE_PROBE_WIDTH 128
+
+// Skips saves while the output has not changed. Each save is summarized by
+// a small probe frame (see FramePipeline::probe); a save is skipped if the
+// mean absolute difference to the probe of the last saved frame is below
+// the threshold in every channel, unless the last save is older than the
+// maximum skip interval.
+class SaveGate {
+private:
+  double threshold;
+  std::chrono::steady_clock::duration maxSkip;
+  std::chrono::steady_clock::time_point lastSaved;
+  cv::Mat last;
+  cv::Mat diff;
+  double difference_;
+  int64_t skipped_;
+
+public:
+  // threshold in 8-bit levels (0 disables the gate); maxSkip in seconds
+  SaveGate(double threshold, double maxSkip);
+
+  bool enabled() const;
+
+  // true if the frame summarized by probe should be saved; the probe is
+  // kept as the new reference when it is
+  bool admit(const cv::Mat &probe);
+
+  // largest per-channel mean absolute difference (8-bit levels) found by
+  // the last admit
+  double difference() const;
+  int64_t skipped() const;
+};
+
+#endif /* A8C3E6F1_92B4_4D07_8E5A_3F1B7D20C964 */
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Scheduler.h"
+#include <algorithm>
+#include <limits>
+
+Scheduler::Scheduler() : nextDue(std::numeric_limits<int64_t>::max()) {}
+
+int64_t Scheduler::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Scheduler::schedule(Entry &entry, int64_t t, bool first) {
+  if (entry.interval <= 0) {
+    entry.due = t; // every poll
+    return;
+  }
+  if (entry.aligned) {
+    int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    // the boundary after the one that fired, even if the task fired a little
+    // early or late by the wall clock; boundaries already over are skipped,
+    // and so are those a wall clock set back would make wait too long
+    int64_t next = (wall / entry.interval + 1) * entry.interval;
+    if (!first) {
+      entry.boundary += entry.interval;
+    }
+    if (first || entry.boundary <= wall ||
+        entry.boundary - wall > entry.interval) {
+      entry.boundary = next;
+    }
+    entry.due = t + (entry.boundary - wall);
+  } else if (first) {
+    entry.due = t;
+  } else if (entry.due <= t) {
+    // skip the firings missed while the frame loop was busy
+    entry.due += ((t - entry.due) / entry.interval + 1) * entry.interval;
+  }
+}
+
+size_t Scheduler::add(std::chrono::nanoseconds interval, Task fn,
+                      bool aligned) {
+  int64_t t = now();
+  entries.push_back(Entry{interval.count(), t, t, 0, aligned, fn});
+  schedule(entries.back(), t, true);
+  nextDue = std::min(nextDue, entries.back().due);
+  return entries.size() - 1;
+}
+
+Scheduler &Scheduler::poll() {
+  int64_t t = now();
+  if (t < nextDue) {
+    return *this;
+  }
+  nextDue = std::numeric_limits<int64_t>::max();
+  for (Entry &entry : entries) {
+    if (entry.due <= t) {
+      entry.fn(std::chrono::nanoseconds{t - entry.last});
+      entry.last = t;
+      schedule(entry, now(), false);
+    }
+    nextDue = std::min(nextDue, entry.due);
+  }
+  return *this;
+}
+
+Scheduler &Scheduler::fire(size_t id) {
+  Entry &entry = entries.at(id);
+  int64_t t = now();
+  entry.fn(std::chrono::nanoseconds{t - entry.last});
+  entry.last = t;
+  return *this;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef D3F81A62_2C47_4B0E_A5D9_8E61C4B7F093
+#define D3F81A62_2C47_4B0E_A5D9_8E61C4B7F093
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Runs periodic tasks from the frame loop. Due times are integer nanoseconds
+// on the monotonic clock, so they do not drift however long moria runs.
+// Until the earliest task is due, poll() costs one clock read and one
+// comparison. An aligned task fires on wall-clock multiples of its interval
+// (e.g. :00, :10, :20 for 10 seconds), and is realigned every time it fires
+// so clock adjustments do not move it off the boundaries.
+class Scheduler {
+public:
+  // called with the time elapsed since the task last ran
+  typedef std::function<void(std::chrono::nanoseconds)> Task;
+
+private:
+  struct Entry {
+    int64_t interval;
+    int64_t due;
+    int64_t last;
+    // aligned tasks: the wall-clock boundary (ns since the epoch) due next
+    int64_t boundary;
+    bool aligned;
+    Task fn;
+  };
+  std::vector<Entry> entries;
+  int64_t nextDue;
+
+  static int64_t now();
+  void schedule(Entry &entry, int64_t t, bool first);
+
+public:
+  Scheduler();
+
+  // add a task; unaligned tasks first run on the next poll, aligned tasks on
+  // the next wall-clock boundary. Returns an id for fire().
+  size_t add(std::chrono::nanoseconds interval, Task fn, bool aligned = false);
+
+  // run the tasks that are due
+  Scheduler &poll();
+
+  // run a task now, keeping its schedule
+  Scheduler &fire(size_t id);
+};
+
+#endif /* D3F81A62_2C47_4B0E_A5D9_8E61C4B7F093 */
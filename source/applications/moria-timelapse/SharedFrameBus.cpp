@@ -0,0 +1,136 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SharedFrameBus.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::string shared_frame_bus_path(const std::string &name) {
+  return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+SharedFrameBus::SharedFrameBus(const std::string &name, u_int slots)
+    : path(shared_frame_bus_path(name)), slots(slots), header(nullptr),
+      mappedBytes(0), next(0), captureSequence(-1) {
+  if (path.size() < 2) {
+    throw std::runtime_error("Moria: Shared frame bus name is empty.");
+  }
+  if (slots < 2) {
+    std::stringstream errs;
+    errs << "Moria: Shared frame bus needs at least 2 slots (" << slots
+         << ")";
+    throw std::runtime_error(errs.str());
+  }
+}
+
+SharedFrameBus::~SharedFrameBus() {
+  if (header) {
+    munmap(header, mappedBytes);
+    shm_unlink(path.c_str());
+  }
+}
+
+void SharedFrameBus::create(size_t frameBytes) {
+  size_t slotStride = (sizeof(SharedFrameSlot) + frameBytes + 63) / 64 * 64;
+  mappedBytes = sizeof(SharedFrameBusHeader) + slotStride * slots;
+
+  // replace a ring left behind by a previous run
+  shm_unlink(path.c_str());
+  int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(mappedBytes)) != 0) {
+    std::stringstream errs;
+    errs << "Moria: Unable to create shared frame bus (" << path
+         << "): " << std::strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(path.c_str());
+    }
+    throw std::runtime_error(errs.str());
+  }
+  void *base = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    throw std::runtime_error("Moria: Unable to map shared frame bus.");
+  }
+
+  // the new segment is zero filled, so every slot lock starts at 0 (empty)
+  header = new (base) SharedFrameBusHeader();
+  header->version = SHARED_FRAME_BUS_VERSION;
+  header->slotCount = slots;
+  header->slotBytes = frameBytes;
+  header->slotStride = slotStride;
+  header->head.store(0, std::memory_order_relaxed);
+  next = 0;
+  char *slotBase = static_cast<char *>(base) + sizeof(SharedFrameBusHeader);
+  for (u_int i = 0; i < slots; i++) {
+    new (slotBase + i * slotStride) SharedFrameSlot();
+  }
+  // readers check the magic last
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, SHARED_FRAME_BUS_MAGIC, sizeof(header->magic));
+}
+
+void SharedFrameBus::publish(const cv::Mat &frame, const FrameInfo &info) {
+  if (frame.empty()) {
+    return;
+  }
+  size_t rowBytes = frame.cols * frame.elemSize();
+  size_t frameBytes = rowBytes * frame.rows;
+  if (header && frameBytes > header->slotBytes) {
+    // the camera came back at a larger size; readers follow the new
+    // segment once they see that the old one was replaced
+    munmap(header, mappedBytes);
+    header = nullptr;
+  }
+  if (!header) {
+    create(frameBytes);
+  }
+
+  captureSequence = info.sequence >= 0 ? info.sequence
+                                       : captureSequence + 1 + info.dropped;
+
+  uint64_t s = next++;
+  char *slotBase = reinterpret_cast<char *>(header) +
+                   sizeof(SharedFrameBusHeader) +
+                   (s % header->slotCount) * header->slotStride;
+  SharedFrameSlot *slot = reinterpret_cast<SharedFrameSlot *>(slotBase);
+
+  slot->lock.store(2 * s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->rows = frame.rows;
+  slot->cols = frame.cols;
+  slot->type = frame.type();
+  slot->sequence = captureSequence;
+  slot->timestamp = info.timestamp.count();
+  char *data = slotBase + sizeof(SharedFrameSlot);
+  if (frame.isContinuous()) {
+    std::memcpy(data, frame.data, frameBytes);
+  } else {
+    for (int y = 0; y < frame.rows; y++) {
+      std::memcpy(data + y * rowBytes, frame.ptr(y), rowBytes);
+    }
+  }
+
+  slot->lock.store(2 * s + 2, std::memory_order_release);
+  header->head.store(s + 1, std::memory_order_release);
+}
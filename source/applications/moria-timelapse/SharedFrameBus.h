@@ -0,0 +1,87 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef C0518FFC_6DA9_404B_8882_6312931A3233
+#define C0518FFC_6DA9_404B_8882_6312931A3233
+
+#include "FrameSource.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#define SHARED_FRAME_BUS_MAGIC "MORIAFB"
+#define SHARED_FRAME_BUS_VERSION 1
+
+// Layout of the shared-memory frame ring. The header is followed by
+// slotCount slots of slotStride bytes; each slot starts with a
+// SharedFrameSlot and is followed by the pixel data.
+struct alignas(64) SharedFrameBusHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t slotCount;
+  uint64_t slotBytes;
+  uint64_t slotStride;
+  // bus sequence of the next frame to be written
+  std::atomic<uint64_t> head;
+};
+
+// Slots are guarded by a sequence lock: the writer stores 2s+1 while
+// writing bus sequence s and 2s+2 once the frame is complete. A reader
+// copies the frame and accepts it only if the lock read the same, even
+// value before and after the copy.
+struct alignas(64) SharedFrameSlot {
+  std::atomic<uint64_t> lock;
+  int32_t rows;
+  int32_t cols;
+  int32_t type;
+  int32_t reserved;
+  // capture sequence, counting frames dropped ahead of the bus
+  int64_t sequence;
+  int64_t timestamp;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared frame bus requires lock-free 64-bit atomics");
+
+// normalized POSIX shared-memory object name for a bus
+std::string shared_frame_bus_path(const std::string &name);
+
+// Single writer of a shared-memory frame ring. The segment is created on
+// the first published frame and sized for frames of that size; a larger
+// frame replaces it with a bigger segment under the same name. The writer
+// never waits for readers; a reader that falls behind by more than the
+// ring size skips ahead and sees the gap in the frame sequence.
+class SharedFrameBus {
+private:
+  std::string path;
+  u_int slots;
+  SharedFrameBusHeader *header;
+  size_t mappedBytes;
+  uint64_t next;
+  int64_t captureSequence;
+
+  void create(size_t frameBytes);
+
+public:
+  SharedFrameBus(const std::string &name, u_int slots);
+  ~SharedFrameBus();
+  SharedFrameBus(const SharedFrameBus &) = delete;
+  SharedFrameBus &operator=(const SharedFrameBus &) = delete;
+
+  void publish(const cv::Mat &frame, const FrameInfo &info);
+};
+
+#endif /* C0518FFC_6DA9_404B_8882_6312931A3233 */
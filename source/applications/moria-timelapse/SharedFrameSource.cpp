@@ -0,0 +1,198 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SharedFrameSource.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#define ENDL "\n"
+
+// polling interval while waiting for the writer
+#define POLL_INTERVAL_US 500
+// an empty frame is returned if the writer has been silent this long
+#define READ_TIMEOUT_MS 1000
+// while waiting, look for a new or replaced bus this often
+#define BUS_CHECK_MS 100
+
+SharedFrameSource::SharedFrameSource(std::shared_ptr<MoriaOptions> options)
+    : path(shared_frame_bus_path(options->shmSource())), header(nullptr),
+      mappedBytes(0), device(0), inode(0), cursor(0),
+      verbose(options->verbose()) {
+  if (path.size() < 2) {
+    throw std::runtime_error("Moria: Shared frame bus name is empty.");
+  }
+  if (!attach() && verbose) {
+    std::cerr << "Waiting for shared frame bus " << path << ENDL;
+  }
+}
+
+SharedFrameSource::~SharedFrameSource() { detach(); }
+
+bool SharedFrameSource::attach() {
+  // mapped writable: 64-bit atomic loads need write access on some 32-bit
+  // ARM cores
+  int fd = shm_open(path.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return false; // the writer has not published a frame yet
+    }
+    std::stringstream errs;
+    errs << "Moria: Unable to open shared frame bus (" << path
+         << "): " << std::strerror(errno);
+    throw std::runtime_error(errs.str());
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(SharedFrameBusHeader)) {
+    close(fd);
+    return false; // still being created
+  }
+  size_t bytes = static_cast<size_t>(st.st_size);
+  void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Moria: Unable to map shared frame bus.");
+  }
+  SharedFrameBusHeader *h = static_cast<SharedFrameBusHeader *>(base);
+
+  bool valid =
+      std::memcmp(h->magic, SHARED_FRAME_BUS_MAGIC, sizeof(h->magic)) == 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!valid) {
+    munmap(base, bytes);
+    return false; // the writer is still filling in the header
+  }
+  if (h->version != SHARED_FRAME_BUS_VERSION ||
+      sizeof(SharedFrameBusHeader) + h->slotStride * h->slotCount > bytes) {
+    munmap(base, bytes);
+    std::stringstream errs;
+    errs << "Moria: Shared frame bus (" << path
+         << ") has an incompatible version";
+    throw std::runtime_error(errs.str());
+  }
+
+  header = h;
+  mappedBytes = bytes;
+  device = st.st_dev;
+  inode = st.st_ino;
+  // start at the newest frame
+  cursor = header->head.load(std::memory_order_acquire);
+  if (verbose) {
+    std::cerr << "Attached to shared frame bus " << path << ": "
+              << header->slotCount << " slots of " << header->slotBytes
+              << " bytes" << ENDL;
+  }
+  return true;
+}
+
+void SharedFrameSource::detach() {
+  if (header) {
+    munmap(header, mappedBytes);
+    header = nullptr;
+  }
+}
+
+bool SharedFrameSource::replaced() const {
+  // a restarted or resized writer unlinks the segment and creates a new
+  // one under the same name; the old mapping stays valid but goes silent
+  int fd = shm_open(path.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool moved =
+      fstat(fd, &st) == 0 && (st.st_dev != device || st.st_ino != inode);
+  close(fd);
+  return moved;
+}
+
+// the bus is attached or awaited
+bool SharedFrameSource::isOpened() { return true; }
+
+const SharedFrameSlot *SharedFrameSource::slot(uint64_t s) const {
+  const char *base = reinterpret_cast<const char *>(header) +
+                     sizeof(SharedFrameBusHeader) +
+                     (s % header->slotCount) * header->slotStride;
+  return reinterpret_cast<const SharedFrameSlot *>(base);
+}
+
+bool SharedFrameSource::read(cv::Mat &frame, FrameInfo &info) {
+  auto now = std::chrono::steady_clock::now();
+  auto deadline = now + std::chrono::milliseconds(READ_TIMEOUT_MS);
+  auto check = header ? now + std::chrono::milliseconds(BUS_CHECK_MS) : now;
+  for (;;) {
+    uint64_t head = header ? header->head.load(std::memory_order_acquire) : 0;
+    if (!header || head <= cursor) {
+      now = std::chrono::steady_clock::now();
+      if (now >= check) {
+        check = now + std::chrono::milliseconds(BUS_CHECK_MS);
+        if (header && replaced()) {
+          if (verbose) {
+            std::cerr << "Shared frame bus " << path << " was replaced"
+                      << ENDL;
+          }
+          detach();
+        }
+        if (!header && attach()) {
+          continue;
+        }
+      }
+      if (now > deadline) {
+        frame.release();
+        return true; // writer stalled; let the caller count empty frames
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(POLL_INTERVAL_US));
+      continue;
+    }
+    if (head - cursor > header->slotCount - 1) {
+      // overrun; the gap shows up in the capture sequence
+      cursor = head - 1;
+    }
+
+    const SharedFrameSlot *s = slot(cursor);
+    uint64_t lock = s->lock.load(std::memory_order_acquire);
+    if (lock != 2 * cursor + 2) {
+      continue; // overwritten since head was read; catch up
+    }
+    int rows = s->rows, cols = s->cols, type = s->type;
+    int64_t sequence = s->sequence, timestamp = s->timestamp;
+    size_t bytes = rows > 0 && cols > 0 ? static_cast<size_t>(rows) * cols *
+                                              CV_ELEM_SIZE(type)
+                                        : 0;
+    if (bytes == 0 || bytes > header->slotBytes) {
+      cursor++;
+      continue; // torn metadata; skip the slot
+    }
+    frame.create(rows, cols, type);
+    std::memcpy(frame.data, reinterpret_cast<const char *>(s + 1), bytes);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s->lock.load(std::memory_order_relaxed) != lock) {
+      continue; // the writer lapped us during the copy
+    }
+
+    cursor++;
+    info.sequence = sequence;
+    info.timestamp = std::chrono::nanoseconds(timestamp);
+    return true;
+  }
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef C3E31BAC_7A4E_4A5B_8882_CC8C44F0EB19
+#define C3E31BAC_7A4E_4A5B_8882_CC8C44F0EB19
+
+#include "FrameSource.h"
+#include "SharedFrameBus.h"
+#include "moria_options.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// Reads frames published by another moria instance with --publish-shm.
+// The read cursor is private to this reader, so any number of readers can
+// attach without slowing the writer down. A reader may start before the
+// writer; it attaches once the bus is ready and moves to the new segment
+// when the writer restarts or resizes the bus.
+class SharedFrameSource : public FrameSource {
+private:
+  std::string path;
+  SharedFrameBusHeader *header;
+  size_t mappedBytes;
+  dev_t device;
+  ino_t inode;
+  uint64_t cursor;
+  bool verbose;
+
+  bool attach();
+  void detach();
+  bool replaced() const;
+  const SharedFrameSlot *slot(uint64_t s) const;
+
+public:
+  explicit SharedFrameSource(std::shared_ptr<MoriaOptions> options);
+  virtual ~SharedFrameSource();
+  SharedFrameSource(const SharedFrameSource &) = delete;
+  SharedFrameSource &operator=(const SharedFrameSource &) = delete;
+
+  virtual bool isOpened();
+  virtual bool read(cv::Mat &frame, FrameInfo &info);
+};
+
+#endif /* C3E31BAC_7A4E_4A5B_8882_CC8C44F0EB19 */
@@ -0,0 +1,117 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SyntheticFrameSource.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <opencv2/imgproc.hpp>
+#include <thread>
+
+#define ENDL "\n"
+
+// noise frames are precomputed and cycled so generation stays cheap
+#define NOISE_FRAMES 16
+
+SyntheticFrameSource::SyntheticFrameSource(
+    std::shared_ptr<MoriaOptions> options)
+    : size(options->frameWidth(), options->frameHeight()),
+      channels(options->syntheticChannels() == 1 ? 1 : 3),
+      fps(std::max(0.1f, options->captureFPS())), paced(!options->unpaced()),
+      objects(static_cast<int>(options->syntheticObjects())),
+      rampPeriod(options->syntheticRamp()),
+      maxFrames(static_cast<int64_t>(options->syntheticFrames())),
+      sequence(0), dropRate(options->syntheticDrop()), dropRng(0x64726f70) {
+  int type = CV_8UC(channels);
+
+  // diagonal gradient background
+  background.create(size, type);
+  for (int y = 0; y < size.height; y++) {
+    uchar *row = background.ptr<uchar>(y);
+    for (int x = 0; x < size.width; x++) {
+      for (int c = 0; c < channels; c++) {
+        row[x * channels + c] = static_cast<uchar>(
+            32 + (160 * (x + y) / (size.width + size.height)) + 16 * c);
+      }
+    }
+  }
+
+  // fixed seed so runs are reproducible
+  cv::RNG rng(0x6d6f726961);
+  float sigma = options->syntheticNoise();
+  for (int i = 0; i < NOISE_FRAMES && sigma > 0; i++) {
+    cv::Mat n(size, CV_16SC(channels));
+    rng.fill(n, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(sigma));
+    noise.push_back(n);
+  }
+
+  if (options->verbose()) {
+    std::cerr << "Synthetic source: " << size.width << "x" << size.height
+              << ", " << channels << " channel(s), "
+              << (paced ? "paced" : "unpaced") << " at " << fps << " fps"
+              << ENDL;
+  }
+  start = std::chrono::steady_clock::now();
+}
+
+SyntheticFrameSource::~SyntheticFrameSource() {}
+
+bool SyntheticFrameSource::isOpened() { return !background.empty(); }
+
+bool SyntheticFrameSource::read(cv::Mat &frame, FrameInfo &info) {
+  // simulate frames lost on the bus
+  while (dropRate > 0 && (maxFrames <= 0 || sequence < maxFrames) &&
+         dropRng.uniform(0.0, 1.0) < dropRate) {
+    sequence++;
+  }
+  if (maxFrames > 0 && sequence >= maxFrames) {
+    return false;
+  }
+
+  if (paced) {
+    auto due = start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::duration<double>(sequence / fps));
+    std::this_thread::sleep_until(due);
+  }
+
+  // scene time follows the frame sequence, not the wall clock
+  double t = sequence / fps;
+  double brightness = 1.0;
+  if (rampPeriod > 0) {
+    brightness = 0.6 + 0.4 * std::sin(2 * M_PI * t / rampPeriod);
+  }
+  background.convertTo(frame, -1, brightness);
+
+  // objects orbit the frame centre at different speeds
+  int radius = std::max(2, std::min(size.width, size.height) / 16);
+  for (int i = 0; i < objects; i++) {
+    double phase = t * (0.2 + 0.1 * i) + i * 2 * M_PI / objects;
+    cv::Point centre(
+        static_cast<int>(size.width * (0.5 + 0.35 * std::cos(phase))),
+        static_cast<int>(size.height * (0.5 + 0.35 * std::sin(phase * 1.3))));
+    cv::circle(frame, centre, radius,
+               cv::Scalar(255 - 40 * i, 64 + 50 * i, 40 * i), cv::FILLED);
+  }
+
+  if (!noise.empty()) {
+    cv::add(frame, noise[sequence % noise.size()], frame, cv::noArray(),
+            frame.depth());
+  }
+
+  info.sequence = sequence;
+  info.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(t));
+  sequence++;
+  return true;
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef E1D9B4C6_8A3F_4E2D_B7C5_4F0A6D2E8B13
+#define E1D9B4C6_8A3F_4E2D_B7C5_4F0A6D2E8B13
+
+#include "FrameSource.h"
+#include "moria_options.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Generates a deterministic test scene: a static gradient background with
+// a slow brightness ramp, moving objects and sensor noise. Frames are paced
+// at the configured frame rate unless pacing is disabled.
+class SyntheticFrameSource : public FrameSource {
+private:
+  cv::Size size;
+  int channels;
+  double fps;
+  bool paced;
+  int objects;
+  double rampPeriod;
+  int64_t maxFrames;
+  int64_t sequence;
+  double dropRate;
+  cv::RNG dropRng;
+  cv::Mat background;
+  std::vector<cv::Mat> noise;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit SyntheticFrameSource(std::shared_ptr<MoriaOptions> options);
+  virtual ~SyntheticFrameSource();
+
+  virtual bool isOpened();
+  virtual bool read(cv::Mat &frame, FrameInfo &info);
+};
+
+#endif /* E1D9B4C6_8A3F_4E2D_B7C5_4F0A6D2E8B13 */
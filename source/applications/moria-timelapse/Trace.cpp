@@ -0,0 +1,411 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+#define ENDL "\n"
+
+namespace {
+
+// fields are relaxed atomics so dump() may copy events that the owning
+// thread is overwriting; it drops those afterwards (seqlock reader)
+struct TraceEvent {
+  std::atomic<const char *> name;
+  std::atomic<int64_t> start;
+  std::atomic<int64_t> duration;
+};
+
+// copy of an event taken by dump()
+struct TraceRecord {
+  const char *name;
+  int64_t start;
+  int64_t duration;
+};
+
+const double stageBounds[] = TRACE_STAGE_BOUNDS;
+
+// counters are only written by the owning thread; relaxed atomics let the
+// metrics exporter read them at any time
+struct StageHistogram {
+  const char *name;
+  std::atomic<uint64_t> buckets[TRACE_STAGE_BUCKETS];
+  std::atomic<uint64_t> count;
+  std::atomic<int64_t> sum; // nanoseconds
+  std::atomic<int64_t> max; // nanoseconds
+  std::atomic<uint64_t> profile[TRACE_PROFILE_BUCKETS];
+};
+
+// profile bucket of a duration: the value itself below 8 ns, then the top
+// four bits (8 buckets per power of two)
+int profile_bucket(int64_t ns) {
+  uint64_t value = static_cast<uint64_t>(std::max<int64_t>(ns, 0));
+  if (value < 8) {
+    return static_cast<int>(value);
+  }
+  int octave = 63 - __builtin_clzll(value);
+  int bucket = (octave - 2) * 8 + static_cast<int>((value >> (octave - 3)) & 7);
+  return std::min(bucket, TRACE_PROFILE_BUCKETS - 1);
+}
+
+// smallest duration (ns) in a profile bucket
+double profile_lower(int bucket) {
+  if (bucket < 8) {
+    return bucket;
+  }
+  int octave = bucket / 8 + 2;
+  return std::ldexp(8 + bucket % 8, octave - 3);
+}
+
+// single writer (the owning thread); the writer publishes each event by
+// advancing head, and each new stage by advancing stages
+struct ThreadBuffer {
+  int tid;
+  std::string name;
+  std::atomic<uint64_t> head{0};
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+  std::atomic<int> stages{0};
+  StageHistogram histograms[TRACE_MAX_STAGES];
+};
+
+void observe(ThreadBuffer *buffer, const char *name, int64_t duration) {
+  int stages = buffer->stages.load(std::memory_order_relaxed);
+  // scope names are string literals, so pointers identify stages
+  int s = 0;
+  while (s < stages && buffer->histograms[s].name != name) {
+    s++;
+  }
+  if (s == stages) {
+    if (s == TRACE_MAX_STAGES) {
+      return;
+    }
+    StageHistogram &added = buffer->histograms[s];
+    added.name = name;
+    for (auto &bucket : added.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    for (auto &bucket : added.profile) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    added.count.store(0, std::memory_order_relaxed);
+    added.sum.store(0, std::memory_order_relaxed);
+    added.max.store(0, std::memory_order_relaxed);
+    buffer->stages.store(s + 1, std::memory_order_release);
+  }
+  StageHistogram &histogram = buffer->histograms[s];
+
+  double seconds = duration * 1e-9;
+  int b = 0;
+  while (b < TRACE_STAGE_BUCKETS - 1 && seconds > stageBounds[b]) {
+    b++;
+  }
+  auto bump = [](std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  };
+  bump(histogram.buckets[b]);
+  bump(histogram.profile[profile_bucket(duration)]);
+  bump(histogram.count);
+  histogram.sum.store(histogram.sum.load(std::memory_order_relaxed) + duration,
+                      std::memory_order_relaxed);
+  if (duration > histogram.max.load(std::memory_order_relaxed)) {
+    histogram.max.store(duration, std::memory_order_relaxed);
+  }
+}
+
+// buffers outlive their threads so finished cameras stay in the trace
+std::mutex registryLock;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+std::string tracePath;
+std::atomic<bool> dumpRequested(false);
+std::atomic<bool> profileRequested(false);
+// when stage statistics started (trace clock), -1 before
+std::atomic<int64_t> statsStart(-1);
+const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+ThreadBuffer *local_buffer() {
+  if (!localBuffer) {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> guard(registryLock);
+    buffer->tid = static_cast<int>(registry.size()) + 1;
+    registry.push_back(buffer);
+    localBuffer = buffer.get();
+  }
+  return localBuffer;
+}
+
+void request_dump(int) { dumpRequested.store(true); }
+
+void request_profile(int) { profileRequested.store(true); }
+
+void write_string(std::ostream &out, const std::string &text) {
+  out << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) >= 0x20) {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+} // namespace
+
+std::atomic<int> Tracer::mode_(0);
+
+void Tracer::enable(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> guard(registryLock);
+    tracePath = path;
+  }
+  struct sigaction action;
+  action.sa_handler = request_dump;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &action, nullptr);
+  mode_.fetch_or(EVENTS);
+}
+
+void Tracer::enableStats() {
+  int64_t unset = -1;
+  statsStart.compare_exchange_strong(unset, now());
+  mode_.fetch_or(STATS);
+}
+
+void Tracer::enableProfile() {
+  struct sigaction action;
+  action.sa_handler = request_profile;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, nullptr);
+  enableStats();
+  mode_.fetch_or(PROFILE);
+}
+
+double StageStats::quantile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  // midpoint of the bucket holding the q-th duration
+  double rank = q * static_cast<double>(count);
+  uint64_t seen = 0;
+  for (int b = 0; b < TRACE_PROFILE_BUCKETS; b++) {
+    seen += profile[b];
+    if (static_cast<double>(seen) >= rank && profile[b] > 0) {
+      double lower = profile_lower(b);
+      double upper = b + 1 < TRACE_PROFILE_BUCKETS ? profile_lower(b + 1)
+                                                   : lower * 2;
+      return std::min((lower + upper) / 2 * 1e-9, max);
+    }
+  }
+  return max;
+}
+
+void Tracer::printProfile(std::ostream &out) {
+  std::vector<StageStats> stats = stageStats();
+  // by thread, then the most time first
+  std::stable_sort(stats.begin(), stats.end(),
+                   [](const StageStats &a, const StageStats &b) {
+                     return a.thread != b.thread ? a.thread < b.thread
+                                                 : a.sum > b.sum;
+                   });
+  double elapsed = (now() - statsStart.load()) * 1e-9;
+
+  // one write so camera log lines do not interleave with the table
+  std::stringstream table;
+  table << "profile over " << std::fixed << std::setprecision(1) << elapsed
+        << " s; % is the share of the thread's time (nested stages are "
+        << "included in their parents)" << ENDL;
+  table << std::left << std::setw(16) << "thread" << std::setw(20) << "stage"
+        << std::right << std::setw(9) << "count" << std::setw(10) << "mean ms"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+        << std::setw(10) << "max ms" << std::setw(8) << "%" << ENDL;
+  for (const StageStats &stage : stats) {
+    if (stage.count == 0) {
+      continue;
+    }
+    table << std::left << std::setw(16) << stage.thread.substr(0, 15)
+          << std::setw(20) << stage.stage.substr(0, 19) << std::right
+          << std::setw(9) << stage.count << std::setprecision(3)
+          << std::setw(10) << stage.sum / stage.count * 1e3 << std::setw(10)
+          << stage.quantile(0.5) * 1e3 << std::setw(10)
+          << stage.quantile(0.99) * 1e3 << std::setw(10) << stage.max * 1e3
+          << std::setprecision(1) << std::setw(8)
+          << (elapsed > 0 ? stage.sum / elapsed * 100 : 0.0) << ENDL;
+  }
+  out << table.str();
+}
+
+std::vector<StageStats> Tracer::stageStats() {
+  std::vector<StageStats> stats;
+  std::lock_guard<std::mutex> guard(registryLock);
+  for (auto &buffer : registry) {
+    std::string thread = buffer->name.empty() ? "worker" : buffer->name;
+    int stages = buffer->stages.load(std::memory_order_acquire);
+    for (int s = 0; s < stages; s++) {
+      const StageHistogram &histogram = buffer->histograms[s];
+      auto same = [&](const StageStats &entry) {
+        return entry.thread == thread && entry.stage == histogram.name;
+      };
+      auto entry = std::find_if(stats.begin(), stats.end(), same);
+      if (entry == stats.end()) {
+        StageStats added;
+        added.thread = thread;
+        added.stage = histogram.name;
+        std::fill(added.buckets, added.buckets + TRACE_STAGE_BUCKETS, 0);
+        std::fill(added.profile, added.profile + TRACE_PROFILE_BUCKETS, 0);
+        added.count = 0;
+        added.sum = 0;
+        added.max = 0;
+        entry = stats.insert(stats.end(), added);
+      }
+      for (int b = 0; b < TRACE_STAGE_BUCKETS; b++) {
+        entry->buckets[b] +=
+            histogram.buckets[b].load(std::memory_order_relaxed);
+      }
+      for (int b = 0; b < TRACE_PROFILE_BUCKETS; b++) {
+        entry->profile[b] +=
+            histogram.profile[b].load(std::memory_order_relaxed);
+      }
+      entry->count += histogram.count.load(std::memory_order_relaxed);
+      entry->sum += histogram.sum.load(std::memory_order_relaxed) * 1e-9;
+      entry->max = std::max(
+          entry->max, histogram.max.load(std::memory_order_relaxed) * 1e-9);
+    }
+  }
+  return stats;
+}
+
+void Tracer::nameThread(const std::string &name) {
+  ThreadBuffer *buffer = local_buffer();
+  std::lock_guard<std::mutex> guard(registryLock);
+  buffer->name = name;
+}
+
+int64_t Tracer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+void Tracer::record(const char *name, int64_t start, int64_t end) {
+  ThreadBuffer *buffer = local_buffer();
+  int mode = mode_.load(std::memory_order_relaxed);
+  if (mode & STATS) {
+    observe(buffer, name, end - start);
+  }
+  if (!(mode & EVENTS)) {
+    return;
+  }
+  uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  TraceEvent &event = buffer->events[head % TRACE_BUFFER_EVENTS];
+  // seqlock writer: dump() sees head advanced past every event overwritten
+  // by the stores below once it sees one of them
+  std::atomic_thread_fence(std::memory_order_release);
+  event.name.store(name, std::memory_order_relaxed);
+  event.start.store(start, std::memory_order_relaxed);
+  event.duration.store(end - start, std::memory_order_relaxed);
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::poll() {
+  if (dumpRequested.load(std::memory_order_relaxed) &&
+      dumpRequested.exchange(false)) {
+    dump();
+  }
+  if (profileRequested.load(std::memory_order_relaxed) &&
+      profileRequested.exchange(false)) {
+    printProfile(std::cerr);
+  }
+}
+
+bool Tracer::dump() {
+  std::lock_guard<std::mutex> guard(registryLock);
+  if (tracePath.empty()) {
+    return false;
+  }
+  std::string tmp = tracePath + ".tmp";
+  std::ofstream out(tmp);
+  int pid = static_cast<int>(getpid());
+  size_t written = 0;
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  std::vector<TraceRecord> records;
+  for (auto &buffer : registry) {
+    if (!buffer->name.empty()) {
+      out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+          << "\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"args\":{\"name\":";
+      write_string(out, buffer->name);
+      out << "}}";
+      first = false;
+    }
+    // copy the events, then drop those the owning thread may have
+    // overwritten meanwhile: event i is rewritten while head is at i plus
+    // the buffer size
+    uint64_t head = buffer->head.load(std::memory_order_acquire);
+    uint64_t begin =
+        head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+    records.clear();
+    for (uint64_t i = begin; i < head; i++) {
+      const TraceEvent &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+      records.push_back(
+          TraceRecord{event.name.load(std::memory_order_relaxed),
+                      event.start.load(std::memory_order_relaxed),
+                      event.duration.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = buffer->head.load(std::memory_order_relaxed);
+    uint64_t valid =
+        after >= TRACE_BUFFER_EVENTS ? after - TRACE_BUFFER_EVENTS + 1 : 0;
+    for (uint64_t i = std::max(begin, valid); i < head; i++) {
+      const TraceRecord &event = records[i - begin];
+      // complete events with microsecond timestamps
+      out << (first ? "" : ",") << "\n{\"name\":\"" << event.name
+          << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"ts\":" << event.start / 1000 << "." << std::setw(3)
+          << std::setfill('0') << event.start % 1000
+          << ",\"dur\":" << event.duration / 1000 << "." << std::setw(3)
+          << std::setfill('0') << event.duration % 1000 << "}";
+      first = false;
+      written++;
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+
+  if (!out || std::rename(tmp.c_str(), tracePath.c_str()) != 0) {
+    std::cerr << "Warning: unable to write trace " << tracePath << ENDL;
+    return false;
+  }
+  std::cerr << "trace: " << written << " events written to " << tracePath
+            << ENDL;
+  return true;
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef C3F09A61_4B8E_4D2A_9C75_8E16D4B2A0F7
+#define C3F09A61_4B8E_4D2A_9C75_8E16D4B2A0F7
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// events kept per thread; older events are overwritten
+#define TRACE_BUFFER_EVENTS 32768
+// distinct stage names timed per thread
+#define TRACE_MAX_STAGES 32
+// stage duration histogram buckets (upper bounds, seconds) and +Inf
+#define TRACE_STAGE_BOUNDS                                                     \
+  { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5 }
+#define TRACE_STAGE_BUCKETS 13
+// stage duration profile buckets: exact below 8 ns, then 8 per power of two
+// up to 2^40 ns (about 18 minutes), so quantiles are within 1/16
+#define TRACE_PROFILE_BUCKETS 304
+
+// Duration statistics of one stage, summed over the threads of one name
+struct StageStats {
+  std::string thread;
+  std::string stage;
+  // per-bucket (not cumulative) counts, the last bucket is +Inf
+  uint64_t buckets[TRACE_STAGE_BUCKETS];
+  uint64_t count;
+  double sum; // seconds
+  double max; // seconds
+  // finer per-bucket counts for quantiles
+  uint64_t profile[TRACE_PROFILE_BUCKETS];
+
+  // estimated duration (seconds) at quantile q (0-1)
+  double quantile(double q) const;
+};
+
+// Process-wide scoped tracing. Each thread records complete events into its
+// own ring buffer without locking; the buffers are written as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev) on SIGUSR2 and at exit. The same
+// scopes can also feed per-thread stage duration histograms (for metrics and
+// the profile table). While all are disabled a trace scope costs one relaxed
+// atomic load.
+class Tracer {
+private:
+  enum Mode { EVENTS = 1, STATS = 2, PROFILE = 4 };
+  static std::atomic<int> mode_;
+
+public:
+  static bool enabled() { return mode_.load(std::memory_order_relaxed) != 0; }
+
+  // start tracing; the trace is written to path
+  static void enable(const std::string &path);
+
+  // start collecting stage duration histograms
+  static void enableStats();
+
+  // collect stage duration histograms and print them as a table on SIGUSR1
+  // and at exit
+  static void enableProfile();
+  static bool profiling() {
+    return (mode_.load(std::memory_order_relaxed) & PROFILE) != 0;
+  }
+
+  // print the per-stage duration table
+  static void printProfile(std::ostream &out);
+
+  // histograms of every stage timed so far
+  static std::vector<StageStats> stageStats();
+
+  // name shown for the calling thread
+  static void nameThread(const std::string &name);
+
+  // nanoseconds on the trace clock (steady_clock)
+  static int64_t now();
+
+  // record an event of the calling thread; name must outlive the tracer
+  static void record(const char *name, int64_t start, int64_t end);
+
+  // write the trace if SIGUSR2 arrived, print the profile if SIGUSR1
+  // arrived; cheap enough to call per frame
+  static void poll();
+
+  // write the trace now; returns false (after logging) on failure (or if
+  // only stage statistics are collected)
+  static bool dump();
+};
+
+// Records the lifetime of the scope as one trace event
+class TraceScope {
+private:
+  const char *name;
+  int64_t start;
+
+public:
+  explicit TraceScope(const char *name)
+      : name(Tracer::enabled() ? name : nullptr),
+        start(this->name ? Tracer::now() : 0) {}
+  ~TraceScope() {
+    if (name) {
+      Tracer::record(name, start, Tracer::now());
+    }
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// trace the enclosing scope under a string literal name
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+#endif /* C3F09A61_4B8E_4D2A_9C75_8E16D4B2A0F7 */
@@ -0,0 +1,147 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "VideoCaptureSource.h"
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+// luminance-only pixel formats which the backend would otherwise expand to BGR
+static bool is_monochrome_fourcc(int fourcc) {
+  static const int formats[] = {
+      cv::VideoWriter::fourcc('G', 'R', 'E', 'Y'),
+      cv::VideoWriter::fourcc('Y', '8', '0', '0'),
+      cv::VideoWriter::fourcc('Y', '8', ' ', ' '),
+      cv::VideoWriter::fourcc('Y', '1', '6', ' ')};
+  for (int format : formats) {
+    if (fourcc == format) {
+      return true;
+    }
+  }
+  return false;
+}
+
+VideoCaptureSource::VideoCaptureSource(std::shared_ptr<MoriaOptions> options,
+                                       const BayerFormat &bayer)
+    : bayer(bayer), position(-1) {
+  if (options->gstPipeline().empty()) {
+    c.open(options->deviceID(), options->apiID());
+    if (options->mjpeg()) {
+      c.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    }
+    c.set(cv::CAP_PROP_FRAME_WIDTH, options->frameWidth());
+    c.set(cv::CAP_PROP_FRAME_HEIGHT, options->frameHeight());
+    c.set(cv::CAP_PROP_FPS, options->captureFPS());
+  } else {
+    c.open(options->gstPipeline());
+  }
+  if (options->mjpeg()) {
+    if (bayer.enabled()) {
+      throw std::runtime_error(
+          "Moria: MJPEG and raw Bayer capture are mutually exclusive.");
+    }
+    mjpeg.reset(new MjpegDecoder(options->mjpegScale()));
+    // deliver compressed frames (gstreamer image/jpeg caps already do)
+    if (options->gstPipeline().empty()) {
+      c.set(cv::CAP_PROP_FORMAT, -1);
+    }
+  }
+  if (bayer.enabled()) {
+    // deliver the undecoded sensor buffer; demosaicing is done by Moria
+    c.set(cv::CAP_PROP_CONVERT_RGB, 0);
+  } else if (is_monochrome_fourcc(
+                 static_cast<int>(c.get(cv::CAP_PROP_FOURCC)))) {
+    // keep luminance frames single-channel so Moria selects the mono pipeline
+    c.set(cv::CAP_PROP_CONVERT_RGB, 0);
+  }
+  frameSize = cv::Size(static_cast<int>(c.get(cv::CAP_PROP_FRAME_WIDTH)),
+                       static_cast<int>(c.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  if (options->verbose()) {
+    int fourcc = c.get(cv::CAP_PROP_FOURCC);
+    std::cerr << "Opened camera using " << c.getBackendName() << " backend."
+              << ENDL;
+    if (options->gstPipeline().empty()) {
+      std::cerr << "Camera deviceID: " << options->deviceID() << ENDL;
+    } else {
+      std::cerr << "gstreamer pipeline: \"" << options->gstPipeline() << "\""
+                << ENDL;
+    }
+    std::cerr << "frame width:  " << c.get(cv::CAP_PROP_FRAME_WIDTH) << ENDL;
+    std::cerr << "frame height: " << c.get(cv::CAP_PROP_FRAME_HEIGHT) << ENDL;
+    std::cerr << "FPS:          " << c.get(cv::CAP_PROP_FPS) << ENDL;
+    if (fourcc)
+      std::cerr << "FOURCC:       " << static_cast<char>(fourcc)
+                << static_cast<char>(fourcc >> 8)
+                << static_cast<char>(fourcc >> 16)
+                << static_cast<char>(fourcc >> 24) << ENDL;
+    if (mjpeg)
+      std::cerr << "MJPEG decode: 1/" << mjpeg->scale() << " scale" << ENDL;
+    if (bayer.enabled())
+      std::cerr << "Bayer:        " << options->bayerPattern() << ", "
+                << bayer.bits() << "-bit" << (bayer.packed() ? " packed" : "")
+                << ENDL;
+  }
+}
+
+VideoCaptureSource::~VideoCaptureSource() {
+  if (c.isOpened()) {
+    c.release();
+  }
+}
+
+bool VideoCaptureSource::isOpened() { return c.isOpened(); }
+
+bool VideoCaptureSource::read(cv::Mat &frame, FrameInfo &info) {
+  if (mjpeg) {
+    c >> raw;
+    if (!mjpeg->decode(raw, frame)) {
+      frame.release();
+    }
+  } else if (bayer.enabled()) {
+    c >> raw;
+    if (raw.empty()) {
+      frame.release();
+    } else {
+      bayer.unpack(raw, frameSize, frame);
+    }
+  } else {
+    c >> frame;
+  }
+
+  // prefer the driver's buffer timestamp; fall back to the time of arrival
+  double msec = c.get(cv::CAP_PROP_POS_MSEC);
+  if (msec > 0) {
+    info.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double, std::milli>(msec));
+  } else {
+    info.timestamp = std::chrono::steady_clock::now().time_since_epoch();
+  }
+
+  // prefer the backend's frame counter, which also counts frames dropped
+  // before they reached us. Backends without one report 0 or a value that
+  // never moves; the sequence is then left unknown and the gap detector
+  // falls back to the frame timestamps.
+  double pos = c.get(cv::CAP_PROP_POS_FRAMES);
+  info.sequence = pos >= 0 && pos != position ? std::llround(pos) : -1;
+  position = pos;
+
+  // cameras never end; empty frames are handled by the caller
+  return true;
+}
+
+bool VideoCaptureSource::set(int prop, double value) {
+  return c.set(prop, value);
+}
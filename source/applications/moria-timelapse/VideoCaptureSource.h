@@ -0,0 +1,46 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef C8E5A3B7_2F1D_4A6C_9D84_1B7F3E5C2A90
+#define C8E5A3B7_2F1D_4A6C_9D84_1B7F3E5C2A90
+
+#include "BayerFormat.h"
+#include "FrameSource.h"
+#include "MjpegDecoder.h"
+#include "moria_options.h"
+#include <memory>
+#include <opencv2/videoio.hpp>
+
+// Frames from a camera or gstreamer pipeline via cv::VideoCapture
+class VideoCaptureSource : public FrameSource {
+private:
+  cv::VideoCapture c;
+  BayerFormat bayer;
+  std::unique_ptr<MjpegDecoder> mjpeg;
+  cv::Size frameSize;
+  cv::Mat raw;
+  // last frame counter reported by the backend
+  double position;
+
+public:
+  VideoCaptureSource(std::shared_ptr<MoriaOptions> options,
+                     const BayerFormat &bayer);
+  virtual ~VideoCaptureSource();
+
+  virtual bool isOpened();
+  virtual bool read(cv::Mat &frame, FrameInfo &info);
+  virtual bool set(int prop, double value);
+};
+
+#endif /* C8E5A3B7_2F1D_4A6C_9D84_1B7F3E5C2A90 */
@@ -0,0 +1,342 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "VideoEncoderSink.h"
+#include "Trace.h"
+#include <algorithm>
+#include <iostream>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#define ENDL "\n"
+
+// saved frames waiting for the encoder; older frames are dropped beyond this
+#define ENCODE_QUEUE_LIMIT 8
+
+#ifdef MORIA_HAVE_FFMPEG
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+static std::string av_error(int err) {
+  char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+  av_strerror(err, buf, sizeof(buf));
+  return buf;
+}
+
+// software encoders tried for each codec, in order of preference
+static const AVCodec *find_encoder(const std::string &codec) {
+  const char *candidates[3] = {nullptr, nullptr, nullptr};
+  if (codec == "h264") {
+    candidates[0] = "libx264";
+  } else if (codec == "hevc" || codec == "h265") {
+    candidates[0] = "libx265";
+  } else if (codec == "av1") {
+    candidates[0] = "libsvtav1";
+    candidates[1] = "libaom-av1";
+  }
+  for (const char *name : candidates) {
+    if (name) {
+      const AVCodec *encoder = avcodec_find_encoder_by_name(name);
+      if (encoder) {
+        return encoder;
+      }
+    }
+  }
+  // any encoder known to FFmpeg by name
+  return avcodec_find_encoder_by_name(codec.c_str());
+}
+
+// One open output file with its encoder
+struct VideoEncoderSink::Segment {
+  AVFormatContext *format = nullptr;
+  AVCodecContext *context = nullptr;
+  AVStream *stream = nullptr;
+  AVFrame *picture = nullptr;
+  AVPacket *packet = nullptr;
+  cv::Size size;
+  cv::Mat bgr, yuv;
+  int64_t pts = 0;
+  // packet bytes written to the file
+  uint64_t bytes = 0;
+
+  Segment(const std::string &path, const std::string &codec,
+          const std::string &container, cv::Size size, int fps, int crf)
+      : size(size) {
+    const AVCodec *encoder = find_encoder(codec);
+    if (!encoder) {
+      release();
+      throw std::runtime_error("Moria: No FFmpeg encoder for video codec (" +
+                               codec + ")");
+    }
+    // the muxer is chosen from the file extension
+    int err =
+        avformat_alloc_output_context2(&format, nullptr, nullptr, path.c_str());
+    if (err < 0 || !format) {
+      release();
+      throw std::runtime_error("Moria: Unsupported video container (" +
+                               container + "): " + av_error(err));
+    }
+
+    stream = avformat_new_stream(format, nullptr);
+    context = avcodec_alloc_context3(encoder);
+    picture = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (!stream || !context || !picture || !packet) {
+      release();
+      throw std::runtime_error("Moria: Unable to allocate video encoder.");
+    }
+
+    context->width = size.width;
+    context->height = size.height;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = AVRational{1, fps};
+    context->framerate = AVRational{fps, 1};
+    context->gop_size = fps;
+    context->bit_rate = 0; // constant quality (crf)
+    if (format->oformat->flags & AVFMT_GLOBALHEADER) {
+      context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *codecOptions = nullptr;
+    av_dict_set_int(&codecOptions, "crf", crf, 0);
+    err = avcodec_open2(context, encoder, &codecOptions);
+    av_dict_free(&codecOptions);
+    if (err < 0) {
+      release();
+      throw std::runtime_error("Moria: Unable to open video encoder: " +
+                               av_error(err));
+    }
+    avcodec_parameters_from_context(stream->codecpar, context);
+    stream->time_base = context->time_base;
+
+    picture->format = context->pix_fmt;
+    picture->width = size.width;
+    picture->height = size.height;
+    err = av_frame_get_buffer(picture, 0);
+    if (err >= 0) {
+      err = avio_open(&format->pb, path.c_str(), AVIO_FLAG_WRITE);
+    }
+    if (err >= 0) {
+      // fragmented MP4 stays playable if the process dies mid-segment
+      AVDictionary *muxOptions = nullptr;
+      if (container == "mp4" || container == "mov") {
+        av_dict_set(&muxOptions, "movflags", "frag_keyframe+empty_moov", 0);
+      }
+      err = avformat_write_header(format, &muxOptions);
+      av_dict_free(&muxOptions);
+    }
+    if (err < 0) {
+      release();
+      throw std::runtime_error("Moria: Unable to create video segment (" +
+                               path + "): " + av_error(err));
+    }
+  }
+
+  ~Segment() {
+    if (format && format->pb) {
+      // flush delayed frames and finish the file
+      send(nullptr);
+      av_write_trailer(format);
+    }
+    release();
+  }
+
+  void release() {
+    if (format && format->pb) {
+      avio_closep(&format->pb);
+    }
+    avcodec_free_context(&context);
+    av_frame_free(&picture);
+    av_packet_free(&packet);
+    if (format) {
+      avformat_free_context(format);
+      format = nullptr;
+    }
+  }
+
+  void send(AVFrame *frame) {
+    if (avcodec_send_frame(context, frame) < 0) {
+      return;
+    }
+    while (avcodec_receive_packet(context, packet) == 0) {
+      av_packet_rescale_ts(packet, context->time_base, stream->time_base);
+      packet->stream_index = stream->index;
+      bytes += static_cast<uint64_t>(packet->size);
+      av_interleaved_write_frame(format, packet);
+    }
+  }
+
+  void encode(const cv::Mat &frame) {
+    const cv::Mat *src = &frame;
+    if (frame.channels() == 1) {
+      cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR);
+      src = &bgr;
+    }
+    // I420: full-size Y plane followed by quarter-size U and V planes
+    cv::cvtColor((*src)(cv::Rect(0, 0, size.width, size.height)), yuv,
+                 cv::COLOR_BGR2YUV_I420);
+
+    av_frame_make_writable(picture);
+    const uchar *plane = yuv.data;
+    for (int p = 0; p < 3; p++) {
+      int w = p == 0 ? size.width : size.width / 2;
+      int h = p == 0 ? size.height : size.height / 2;
+      for (int y = 0; y < h; y++) {
+        std::copy(plane + y * w, plane + (y + 1) * w,
+                  picture->data[p] + y * picture->linesize[p]);
+      }
+      plane += w * h;
+    }
+    picture->pts = pts++;
+    send(picture);
+  }
+};
+
+#else
+
+struct VideoEncoderSink::Segment {
+  Segment(const std::string &, const std::string &, const std::string &,
+          cv::Size, int, int) {
+    throw std::runtime_error(
+        "Moria: Video output requires a build with FFmpeg.");
+  }
+  cv::Size size;
+  uint64_t bytes = 0;
+  void encode(const cv::Mat &) {}
+};
+
+#endif
+
+VideoEncoderSink::VideoEncoderSink(std::shared_ptr<MoriaOptions> options)
+    : outDir(options->outDir()), codec(options->videoCodec()),
+      container(options->videoContainer()),
+      fps(static_cast<int>(std::max(1u, options->videoFps()))),
+      crf(static_cast<int>(options->videoCrf())),
+      verbose(options->verbose()),
+      tag(options->cameraName().empty() ? std::string()
+                                        : "[" + options->cameraName() + "] "),
+      queued(0), bytes(0), stopping(false) {
+#ifdef MORIA_HAVE_FFMPEG
+  worker = std::thread(&VideoEncoderSink::encode_loop, this);
+#else
+  throw std::runtime_error(
+      "Moria: Video output requires a build with FFmpeg.");
+#endif
+}
+
+VideoEncoderSink::~VideoEncoderSink() { close(); }
+
+std::string VideoEncoderSink::write(const OutputFrame &frame,
+                                    const SaveTime &saved) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (queue.size() >= ENCODE_QUEUE_LIMIT) {
+    queue.pop_front();
+    std::cerr << tag
+              << "Warning: video encoder is falling behind; frame dropped"
+              << ENDL;
+  }
+  queue.push_back(Pending{frame.bgr.clone(), saved});
+  queued = queue.size();
+  wake.notify_one();
+  return std::string(); // encoded asynchronously
+}
+
+void VideoEncoderSink::close() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping) {
+      return;
+    }
+    stopping = true;
+  }
+  wake.notify_one();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void VideoEncoderSink::encode_loop() {
+  if (Tracer::enabled()) {
+    Tracer::nameThread("video encoder");
+  }
+  for (;;) {
+    Pending pending;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this]() { return stopping || !queue.empty(); });
+      if (queue.empty()) {
+        break; // stopping and drained
+      }
+      pending = std::move(queue.front());
+      queue.pop_front();
+      queued = queue.size();
+    }
+    try {
+      encode(pending);
+    } catch (const std::exception &ex) {
+      // keep capturing (also past cv::Exception from the colour conversion);
+      // the next saved frame retries the segment
+      std::cerr << tag << "Warning: " << ex.what() << ENDL;
+      segment.reset();
+    }
+  }
+  // finish the open segment
+  segment.reset();
+}
+
+void VideoEncoderSink::encode(const Pending &pending) {
+  // encoders need even dimensions for 4:2:0 chroma
+  cv::Size size(pending.frame.cols & ~1, pending.frame.rows & ~1);
+  std::string day = pending.saved.format("%Y-%m-%d");
+
+  if (segment && (day != segmentDay || size != segment->size)) {
+    segment.reset();
+    if (verbose) {
+      std::cerr << tag << "close video segment: " << segmentPath << ENDL;
+    }
+  }
+  if (!segment) {
+    // named by start time so a restart never overwrites a segment
+    std::string dir = cv::utils::fs::join(outDir, day);
+    cv::utils::fs::createDirectories(dir);
+    segmentPath = cv::utils::fs::join(
+        dir, pending.saved.format("%Y-%m-%d_%H-%M-%S") + "." + container);
+    segment.reset(new Segment(segmentPath, codec, container, size, fps, crf));
+    segmentDay = day;
+    if (verbose) {
+      std::cerr << tag << "open video segment: " << segmentPath << ENDL;
+    }
+  }
+  TRACE_SCOPE("video encode");
+  uint64_t before = segment->bytes;
+  segment->encode(pending.frame);
+  bytes += segment->bytes - before;
+}
+
+uint64_t VideoEncoderSink::bytesWritten() const { return bytes; }
+
+size_t VideoEncoderSink::queueDepth() const { return queued; }
+
+uint64_t VideoEncoderSink::memory(cv::Size size, int channels) const {
+  uint64_t area = static_cast<uint64_t>(size.area());
+  // queued copies of the saved frame, then BGR and two I420 frames (OpenCV's
+  // and the encoder's picture) while encoding
+  return ENCODE_QUEUE_LIMIT * area * channels + 3 * area + 3 * area;
+}
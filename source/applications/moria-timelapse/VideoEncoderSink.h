@@ -0,0 +1,76 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef F5DD3BDA_A5DE_4F9E_BFC5_E7AC77974B53
+#define F5DD3BDA_A5DE_4F9E_BFC5_E7AC77974B53
+
+#include "FrameSink.h"
+#include "moria_options.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Encodes saved frames into one video segment per day:
+// <outDir>/<YYYY-MM-DD>/<YYYY-MM-DD_HH-MM-SS>.<container>
+// A segment is closed when the day changes or the frame size changes.
+// Encoding runs on a dedicated thread fed by a short queue; requires a
+// build with FFmpeg (libavcodec/libavformat).
+class VideoEncoderSink : public FrameSink {
+private:
+  struct Segment;
+  struct Pending {
+    cv::Mat frame;
+    SaveTime saved;
+  };
+
+  std::string outDir;
+  std::string codec;
+  std::string container;
+  int fps;
+  int crf;
+  bool verbose;
+  // log prefix identifying the camera
+  std::string tag;
+
+  std::unique_ptr<Segment> segment;
+  std::string segmentDay;
+  std::string segmentPath;
+
+  std::deque<Pending> queue;
+  std::atomic<size_t> queued;
+  std::atomic<uint64_t> bytes;
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping;
+  std::thread worker;
+
+  void encode_loop();
+  void encode(const Pending &pending);
+
+public:
+  explicit VideoEncoderSink(std::shared_ptr<MoriaOptions> options);
+  virtual ~VideoEncoderSink();
+
+  virtual std::string write(const OutputFrame &frame, const SaveTime &saved);
+  virtual void close();
+  virtual uint64_t bytesWritten() const;
+  virtual size_t queueDepth() const;
+  virtual uint64_t memory(cv::Size size, int channels) const;
+};
+
+#endif /* F5DD3BDA_A5DE_4F9E_BFC5_E7AC77974B53 */
@@ -0,0 +1,177 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "WorkerPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// one parallel loop; lives on the stack of the calling thread
+struct Job {
+  const WorkerPool::Body *body;
+  cv::Range range;
+  int stripes;
+  std::atomic<int> next{0};
+  std::atomic<int> done{0};
+  // workers running stripes of the job, under the pool lock
+  int users = 0;
+  std::exception_ptr error;
+};
+
+class Pool {
+private:
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  // loops with stripes left to claim
+  std::deque<Job *> jobs;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+
+  // claim and run stripes until none are left
+  void run(Job &job) {
+    int length = job.range.size();
+    for (;;) {
+      int s = job.next.fetch_add(1);
+      if (s >= job.stripes) {
+        return;
+      }
+      cv::Range stripe(
+          job.range.start + static_cast<int>(int64_t(length) * s / job.stripes),
+          job.range.start +
+              static_cast<int>(int64_t(length) * (s + 1) / job.stripes));
+      try {
+        (*job.body)(stripe);
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!job.error) {
+          job.error = std::current_exception();
+        }
+      }
+      job.done.fetch_add(1);
+    }
+  }
+
+  // under the lock
+  void retire(Job *job) {
+    auto found = std::find(jobs.begin(), jobs.end(), job);
+    if (found != jobs.end()) {
+      jobs.erase(found);
+    }
+  }
+
+  void worker_loop() {
+    if (Tracer::enabled()) {
+      Tracer::nameThread("pool");
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+      wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+      if (stopping) {
+        return;
+      }
+      // rotate, so idle workers spread over the loops of all cameras
+      Job *job = jobs.front();
+      jobs.pop_front();
+      jobs.push_back(job);
+      job->users++;
+      guard.unlock();
+      run(*job);
+      guard.lock();
+      retire(job);
+      job->users--;
+      finished.notify_all();
+    }
+  }
+
+public:
+  explicit Pool(unsigned threads) {
+    for (unsigned i = 0; i < threads; i++) {
+      workers.emplace_back(&Pool::worker_loop, this);
+    }
+  }
+
+  ~Pool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+  void parallel_for(const cv::Range &range, const WorkerPool::Body &body) {
+    int length = range.size();
+    int stripes = std::min(
+        length, static_cast<int>(size() + 1) * POOL_STRIPES_PER_THREAD);
+    if (workers.empty() || stripes <= 1) {
+      if (length > 0) {
+        body(range);
+      }
+      return;
+    }
+    Job job;
+    job.body = &body;
+    job.range = range;
+    job.stripes = stripes;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      jobs.push_back(&job);
+    }
+    wake.notify_all();
+    run(job);
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      retire(&job);
+      finished.wait(guard, [&job]() {
+        return job.done.load() == job.stripes && job.users == 0;
+      });
+    }
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+  }
+};
+
+std::atomic<unsigned> configured(0);
+
+Pool &pool() {
+  static Pool instance(configured.load() > 0
+                           ? configured.load()
+                           : std::max(1u, std::thread::hardware_concurrency()));
+  return instance;
+}
+
+} // namespace
+
+void WorkerPool::configure(unsigned threads) { configured = threads; }
+
+unsigned WorkerPool::threads() { return pool().size(); }
+
+void WorkerPool::parallel_for(const cv::Range &range, const Body &body) {
+  pool().parallel_for(range, body);
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef E2B7C4D9_5F13_4A8E_B06C_91D3A7F25E48
+#define E2B7C4D9_5F13_4A8E_B06C_91D3A7F25E48
+
+#include <functional>
+#include <opencv2/core.hpp>
+
+// stripes per thread a parallel loop is split into, so threads that finish
+// early take over the remaining stripes
+#define POOL_STRIPES_PER_THREAD 4
+
+// Worker pool shared by every camera of the process, for the row loops of
+// the filter and the input and output conversions. A loop is split into
+// stripes; the calling thread runs stripes itself while idle workers take
+// the remaining stripes of any camera's loop, so the loops of several
+// cameras run at once. (OpenCV's parallel_for_ runs calls made from several
+// threads one at a time on most of its backends.)
+class WorkerPool {
+public:
+  typedef std::function<void(const cv::Range &)> Body;
+
+  // number of worker threads (0: one per core); only takes effect before
+  // the first parallel loop
+  static void configure(unsigned threads);
+
+  static unsigned threads();
+
+  // run body over the stripes of range and return once all of them ran;
+  // rethrows the first exception thrown by a stripe
+  static void parallel_for(const cv::Range &range, const Body &body);
+};
+
+#endif /* E2B7C4D9_5F13_4A8E_B06C_91D3A7F25E48 */
@@ -16,14 +16,31 @@
 #include "CameraManager.h"
 #include "ChangeDetector.hpp"
 #include "FPSCounter.h"
-#include "IIR_2nd_temporal_filter.hpp"
-#include "IntervalTimer.h"
+#include "FilterCheckpoint.h"
+#include "ArchiveSink.h"
+#include "FrameSink.h"
+#include "FramePipeline.hpp"
+#include "ImageDirectorySink.h"
+#include "LoadGovernor.h"
+#include "MemoryUsage.h"
+#include "MetricsExporter.h"
+#include "PreciseImageSink.h"
+#include "PreviewWindow.h"
+#include "PyramidSink.h"
+#include "SaveGate.h"
+#include "Scheduler.h"
+#include "Trace.h"
+#include "VideoEncoderSink.h"
+#include "WorkerPool.h"
 #include "butterworth_2nd_IIR_params.hpp"
 #include "util.h"
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <csignal>
 #include <ctime>
+#include <exception>
 #include <functional>
 #include <iomanip>
 #include <iostream>
@@ -34,15 +51,145 @@
 #include <opencv2/videoio.hpp>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #define ENDL "\n"
 
+namespace {
+
+// set to stop every camera: the user quit, or SIGINT/SIGTERM arrived
+std::atomic<bool> stopRequested(false);
+
+void request_stop(int) { stopRequested.store(true); }
+
+} // namespace
+
 Moria::Moria() {}
 
 Moria::~Moria() {}
 
 void Moria::run(std::shared_ptr<MoriaOptions> options) {
+  print_version();
+
+  // write the trace and the profile however the run ends
+  struct TraceWriter {
+    ~TraceWriter() {
+      if (Tracer::enabled()) {
+        Tracer::dump();
+      }
+      if (Tracer::profiling()) {
+        Tracer::printProfile(std::cerr);
+      }
+    }
+  } traceWriter;
+  if (!options->trace().empty()) {
+    Tracer::enable(options->trace());
+  }
+  if (options->profile()) {
+    Tracer::enableProfile();
+  }
+  // written every interval and once more when run returns
+  if (!options->metrics().empty()) {
+    metrics.reset(new MetricsExporter(options->metrics(),
+                                      options->metricsInterval()));
+  }
+  struct MetricsWriter {
+    std::unique_ptr<MetricsExporter> &metrics;
+    ~MetricsWriter() { metrics.reset(); }
+  } metricsWriter{metrics};
+
+  // every camera shares one worker pool, which runs the row stripes of each
+  // camera's filter and conversions; OpenCV's own functions keep its pool
+  WorkerPool::configure(options->threads());
+  if (options->threads() > 0) {
+    cv::setNumThreads(static_cast<int>(options->threads()));
+  }
+
+  // the first SIGINT or SIGTERM stops the cameras, which still save their
+  // checkpoints and finish their outputs; a second one ends the process
+  stopRequested = false;
+  struct sigaction action;
+  action.sa_handler = request_stop;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART | SA_RESETHAND;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  auto cameras = options->cameras();
+  if (cameras.size() <= 1) {
+    auto camera = cameras.empty() ? options : cameras.front();
+    if (options->noGUI()) {
+      run_camera(camera, false);
+      return;
+    }
+    // highgui windows and key handling stay on the main thread, which shows
+    // the preview while the camera runs on its own thread
+    preview.reset(new PreviewWindow("Live"));
+    std::exception_ptr error;
+    std::thread worker([&]() {
+      try {
+        run_camera(camera, false);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      preview->close();
+    });
+    preview->run();
+    // the camera may be waiting to reconnect rather than reading keys
+    stopRequested = true;
+    worker.join();
+    preview.reset();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return;
+  }
+
+  std::cerr << "running " << cameras.size() << " cameras on "
+            << WorkerPool::threads() << " worker threads" << ENDL;
+
+  std::vector<std::thread> workers;
+  std::vector<std::exception_ptr> errors(cameras.size());
+  for (size_t i = 0; i < cameras.size(); i++) {
+    workers.emplace_back([&, i]() {
+      try {
+        run_camera(cameras[i], true);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i < cameras.size(); i++) {
+    if (!errors[i]) {
+      continue;
+    }
+    failed++;
+    try {
+      std::rethrow_exception(errors[i]);
+    } catch (const std::exception &ex) {
+      std::cerr << "[" << cameras[i]->cameraName() << "] " << ex.what()
+                << ENDL;
+    } catch (...) {
+      std::cerr << "[" << cameras[i]->cameraName() << "] unknown error"
+                << ENDL;
+    }
+  }
+  if (failed > 0) {
+    std::stringstream errs;
+    errs << "Moria: " << failed << " of " << cameras.size()
+         << " cameras failed";
+    throw std::runtime_error(errs.str());
+  }
+}
+
+void Moria::run_camera(std::shared_ptr<MoriaOptions> options,
+                       bool multiCamera) {
   float filterPeriod = options->filterPeriod();
   bool showFps = options->showFps() || options->verbose();
   bool showFpsChange = options->showFpsChange() || options->verbose();
@@ -53,7 +200,8 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
   std::string outDir = options->outDir();
   bool verbose = options->verbose();
   u_int flip = std::min(3u, std::max(0u, options->flip()));
-  bool noGUI = options->noGUI();
+  // the preview window is shown by the UI thread of a single camera run
+  bool noGUI = options->noGUI() || multiCamera || !preview;
   u_int decimate = std::max(1u, options->decimate());
 
   // font for time text
@@ -61,8 +209,17 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
   double fontScale = 1;
   int thickness = 1;
 
+  // log prefix identifying the camera
+  std::string tag =
+      multiCamera ? "[" + options->cameraName() + "] " : std::string();
+  std::string name = multiCamera ? options->cameraName() : "camera";
+  if (Tracer::enabled()) {
+    Tracer::nameThread(name);
+  }
+  std::shared_ptr<CameraMetrics> cameraMetrics =
+      metrics ? metrics->add(name) : std::make_shared<CameraMetrics>(name);
+
   // print usage info
-  print_version();
   if (!noGUI) {
     std::cout << "Press 'q' key to exit" << ENDL;
     std::cout << "Press 'f' key to toggle FPS display" << ENDL;
@@ -78,6 +235,7 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
   if (!options->recordImages()) {
     std::cerr << ENDL;
     std::cerr
+        << tag
         << "Warning: No output directory specified. Images will not be saved."
         << ENDL;
     std::cerr << ENDL;
@@ -88,8 +246,15 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
       1.0 / filterPeriod, // cut-off freq.
       1);                 // sample rate (FPS)
 
-  // initialize IIR filters; one for each video channel
-  IIR_2nd_temporal_filter<float> filter[3];
+  // filter pipeline; selected from the format of the first captured frame
+  std::unique_ptr<FramePipeline> pipeline;
+
+  // this camera's share of the process memory budget
+  uint64_t memoryBudget = static_cast<uint64_t>(options->memoryBudget()) << 20;
+  struct MemoryReservation {
+    uint64_t bytes = 0;
+    ~MemoryReservation() { MemoryBudget::release(bytes); }
+  } memoryReservation;
 
   // try to initialize output directory
   if (recordImages && !cv::utils::fs::exists(outDir)) {
@@ -100,14 +265,54 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
       throw std::runtime_error(errs.str());
     }
     if (verbose) {
-      std::cerr << "Initialized output directory: " << outDir << ENDL;
+      std::cerr << tag << "Initialized output directory: " << outDir << ENDL;
     }
   }
 
+  // filter state checkpoints
+  std::unique_ptr<FilterCheckpoint> checkpoint;
+  if (!options->checkpoint().empty()) {
+    checkpoint.reset(new FilterCheckpoint(options->checkpoint()));
+  } else if (options->resume()) {
+    throw std::runtime_error("Moria: --resume requires --checkpoint");
+  }
+  bool resume = options->resume();
+
+  auto save_checkpoint = [&]() {
+    if (!checkpoint || !pipeline) {
+      return;
+    }
+    try {
+      TRACE_SCOPE("checkpoint");
+      checkpoint->save(*pipeline, filterParams);
+      if (verbose) {
+        std::cerr << tag << "checkpoint: " << checkpoint->file() << ENDL;
+      }
+    } catch (const std::runtime_error &ex) {
+      // a failed checkpoint must not stop the capture
+      std::cerr << tag << "Warning: " << ex.what() << ENDL;
+    }
+  };
+
+  // periodic tasks, checked once per filter sample
+  Scheduler scheduler;
+  bool alignSaves = options->alignSaves();
+  scheduler.add(
+      std::chrono::milliseconds{
+          static_cast<int64_t>(options->checkpointInterval() * 1000)},
+      [&](std::chrono::nanoseconds elapsed) {
+        (void)elapsed;
+        save_checkpoint();
+      },
+      alignSaves);
+
   //--- Initialize VideoCapture
-  CameraManager cap{cv::VideoCapture()};
+  CameraManager cap;
+  cap.stopWhen([]() { return stopRequested.load(); });
   try {
-    cap.configure(options);
+    cap.configure(options, tag);
+  } catch (const std::runtime_error &) {
+    throw;
   } catch (...) {
     throw std::runtime_error("Moria: Error configuring camera");
   }
@@ -117,9 +322,20 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
     throw std::runtime_error("Moria: Unable to open camera");
   }
 
+  // raw Bayer and monochrome frames arrive as a single plane
+  const BayerFormat &bayer = cap.bayerFormat();
+
+  // crop/bin stage ahead of the filter
+  InputConditioner conditioner(options->roi(), options->bin(),
+                               bayer.enabled());
+
   // FPS Counter
   FPSCounter fpscounter;
 
+  // skips saving frames that have not changed since the last save
+  SaveGate saveGate(options->skipUnchanged(), options->maxSkip());
+  cv::Mat probeFrame;
+
   // FPS Change Detector
   ChangeDetector<float> fpsChangeDetector(
       0.12f, /*threshhold pct*/
@@ -128,14 +344,15 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
         (void)pct_ch;
         auto old_gain = filterParams.gain();
         filterParams.samplerate(static_cast<float>(to));
-        filter[0].resetgain(old_gain, filterParams.gain());
-        filter[1].resetgain(old_gain, filterParams.gain());
-        filter[2].resetgain(old_gain, filterParams.gain());
+        if (pipeline) {
+          pipeline->resetgain(old_gain, filterParams.gain());
+        }
         if (showFpsChange) {
-          std::cerr << "fps changed: {from: " << from << ", to: " << to << "}"
-                    << ENDL;
+          std::cerr << tag << "fps changed: {from: " << from << ", to: " << to
+                    << "}" << ENDL;
           if (verbose) {
-            std::cerr << "new filterParams: {gain: " << filterParams.gain()
+            std::cerr << tag
+                      << "new filterParams: {gain: " << filterParams.gain()
                       << ", B1: " << filterParams.B1()
                       << ", B2: " << filterParams.B2()
                       << ", fc: " << filterParams.passband()
@@ -145,14 +362,29 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
       });
 
   // Timers
-  IntervalTimer fps_printer{
+  size_t fps_printer = scheduler.add(
       std::chrono::seconds{5}, [&](std::chrono::nanoseconds elapsed) {
         (void)elapsed;
-        if (showFps)
-          std::cerr << "fps: " << fpscounter.fps() << ENDL;
-      }};
+        FrameTiming timing = fpscounter.timing();
+        cameraMetrics->fps = timing.fps;
+        cameraMetrics->intervalP50 = timing.p50;
+        cameraMetrics->intervalP99 = timing.p99;
+        if (showFps) {
+          // one write per line so cameras sharing stderr do not interleave
+          std::stringstream line;
+          line << tag << "fps: " << timing.fps << ", frame interval p50/p99: "
+               << timing.p50 * 1e3 << "/" << timing.p99 * 1e3 << " ms"
+               << ", dropped: " << cap.droppedFrames();
+          if (saveGate.enabled()) {
+            line << ", skipped saves: " << saveGate.skipped();
+          }
+          line << ENDL;
+          std::cerr << line.str();
+        }
+      });
 
-  auto imprint_timestamp = [&](cv::Mat &frame) {
+  auto imprint_timestamp = [&](cv::Mat &frame, double value) {
+    TRACE_SCOPE("overlay");
     auto timestamp = std::time(nullptr);
     auto timestamp_to_print =
         useUTCtime ? std::gmtime(&timestamp) : std::localtime(&timestamp);
@@ -168,125 +400,390 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
                       (frame.rows - textSize.height - 2));
 
     cv::putText(frame, timeText.str(), textOrg, fontFace, fontScale,
-                cv::Scalar::all(255), thickness, cv::LINE_AA);
+                cv::Scalar::all(value), thickness, cv::LINE_AA);
   };
 
   // Frame buffers
-  cv::Mat floatFrame;
-  cv::Mat frameChannels[3];
-  cv::Mat outFloatFrame;
-  cv::Mat outFrame;
+  OutputFrame output;
+  cv::Mat &outFrame = output.bgr;
+
+  // output frames are only rendered when they are saved or displayed;
+  // OutputFormat flags not rendered since the last filter update
+  int outputStale = 0;
+
+  auto flip_frame = [&](cv::Mat &frame) {
+    if (flip == 0) {
+      return;
+    }
+    TRACE_SCOPE("flip");
+    switch (flip) {
+    case 1:
+      cv::flip(frame, frame, 1);
+      break;
+    case 2:
+      cv::flip(frame, frame, 0);
+      break;
+    case 3:
+      cv::flip(frame, frame, -1);
+      break;
+    default:
+      break;
+    }
+  };
+
+  // the preview is rendered on its own, at most previewRate times a second
+  cv::Mat previewFrame;
+  float previewRate = options->previewRate();
+  int previewWidth = static_cast<int>(options->previewWidth());
+  bool previewStale = false;
+  bool previewDue = true;
+  if (!noGUI && previewRate > 0) {
+    scheduler.add(
+        std::chrono::nanoseconds{static_cast<int64_t>(1e9 / previewRate)},
+        [&](std::chrono::nanoseconds elapsed) {
+          (void)elapsed;
+          previewDue = true;
+        });
+  }
 
-  std::vector<int> compression_params;
-  compression_params.push_back(cv::IMWRITE_JPEG_QUALITY);
-  compression_params.push_back(95);
+  auto render_output = [&](int formats) {
+    formats &= outputStale;
+    if (!formats) {
+      return;
+    }
+    TRACE_SCOPE("render");
+    outputStale &= ~formats;
+    if (formats & OUTPUT_YCRCB) {
+      bool rendered;
+      {
+        TRACE_SCOPE("output convert");
+        rendered = pipeline->renderPlanes(output.ycrcb);
+      }
+      if (rendered) {
+        // white text on luma, neutral chroma
+        for (int c = 0; c < 3; c++) {
+          flip_frame(output.ycrcb[c]);
+          if (writeTimestampInImage) {
+            imprint_timestamp(output.ycrcb[c], c == 0 ? 255 : 128);
+          }
+        }
+      } else {
+        // the pipeline does not filter in YCrCb; sinks take BGR instead
+        for (int c = 0; c < 3; c++) {
+          output.ycrcb[c].release();
+        }
+        formats |= outputStale & OUTPUT_BGR;
+        outputStale &= ~OUTPUT_BGR;
+      }
+    }
+    if (formats & OUTPUT_BGR) {
+      {
+        TRACE_SCOPE("output convert");
+        pipeline->render(outFrame);
+      }
+      flip_frame(outFrame);
 
-  IntervalTimer image_writer{
+      if (writeTimestampInImage) {
+        imprint_timestamp(outFrame, 255);
+      }
+    }
+    if (formats & OUTPUT_FLOAT) {
+      {
+        TRACE_SCOPE("output convert");
+        pipeline->renderFloat(output.bgrFloat);
+      }
+      flip_frame(output.bgrFloat);
+
+      if (writeTimestampInImage) {
+        imprint_timestamp(output.bgrFloat, 1.0);
+      }
+    }
+  };
+
+  if (options->colorspace() != "xyz" && options->colorspace() != "ycrcb") {
+    throw std::runtime_error("Moria: Unsupported filter colour space (" +
+                             options->colorspace() + ")");
+  }
+  bool ycrcb = options->colorspace() == "ycrcb";
+
+  // destinations for saved frames
+  std::vector<std::unique_ptr<FrameSink>> sinks;
+  if (recordImages && options->saveImages()) {
+    sinks.emplace_back(new ImageDirectorySink(options));
+  }
+  if (recordImages && !options->outputSizes().empty()) {
+    sinks.emplace_back(new PyramidSink(options));
+  }
+  if (recordImages && options->archive()) {
+    sinks.emplace_back(new ArchiveSink(options));
+  }
+  if (recordImages && !options->saveFloat().empty()) {
+    sinks.emplace_back(new PreciseImageSink(options));
+  }
+  if (recordImages && !options->videoCodec().empty()) {
+    sinks.emplace_back(new VideoEncoderSink(options));
+  }
+
+  auto update_sink_metrics = [&]() {
+    uint64_t bytes = 0;
+    size_t queued = 0;
+    for (auto &sink : sinks) {
+      bytes += sink->bytesWritten();
+      queued += sink->queueDepth();
+    }
+    cameraMetrics->bytesWritten = static_cast<int64_t>(bytes);
+    cameraMetrics->queueDepth = static_cast<int64_t>(queued);
+  };
+
+  scheduler.add(
       std::chrono::milliseconds{static_cast<int64_t>(saveInterval * 1000)},
       [&](std::chrono::nanoseconds elapsed) {
         (void)elapsed;
-        if (recordImages && cv::utils::fs::exists(outDir) &&
-            cv::utils::fs::isDirectory(outDir)) {
-          std::stringstream imgDir, imgName;
-
-          auto now_chrono{std::chrono::system_clock::now()};
-          auto since_epoch{now_chrono.time_since_epoch()};
-          auto count_since_epoch = since_epoch.count();
-          auto seconds_since_epoch{(count_since_epoch / 1000000000UL) *
-                                   1000000000UL};
-          auto nanoseconds_since_epoch{count_since_epoch - seconds_since_epoch};
-
-          auto timestamp = std::chrono::system_clock::to_time_t(now_chrono);
-          auto timestamp_to_print =
-              useUTCtime ? std::gmtime(&timestamp) : std::localtime(&timestamp);
-
-          imgDir << std::put_time(timestamp_to_print, "%Y-%m-%d");
-          imgName << std::put_time(timestamp_to_print, "%Y-%m-%d_%H-%M-%S")
-                  << "-"
-                  << std::setw(3) << std::setfill('0')
-                  << static_cast<int>(nanoseconds_since_epoch / 1.0e9 * 1000)
-                  << ".jpg";
-
-          auto imgOutPath = cv::utils::fs::join(outDir, imgDir.str());
-          auto imgOutFilePath = cv::utils::fs::join(imgOutPath, imgName.str());
-
-          cv::utils::fs::createDirectories(imgOutPath);
-
-          cv::imwrite(imgOutFilePath, outFrame, compression_params);
+        if (sinks.empty()) {
+          return;
+        }
+        TRACE_SCOPE("save");
+        if (saveGate.enabled()) {
+          pipeline->probe(probeFrame, SAVE_PROBE_WIDTH);
+          bool save = saveGate.admit(probeFrame);
+          cameraMetrics->skippedSaves = saveGate.skipped();
           if (verbose) {
-            std::cerr << "save image: " << imgOutFilePath << ENDL;
+            std::cerr << tag << "change since last save: "
+                      << saveGate.difference() << (save ? "" : " (skipped)")
+                      << ENDL;
+          }
+          if (!save) {
+            return;
+          }
+        }
+        // render each sink's preferred format once
+        int formats = 0;
+        for (auto &sink : sinks) {
+          formats |= preferredFormat(sink->formats());
+        }
+        render_output(formats);
+        SaveTime saved{std::chrono::system_clock::now(), useUTCtime};
+        for (auto &sink : sinks) {
+          OutputFormat format = preferredFormat(sink->formats());
+          OutputFrame view;
+          if (format == OUTPUT_FLOAT) {
+            view.bgrFloat = output.bgrFloat;
+          } else if (format == OUTPUT_YCRCB && output.hasPlanes()) {
+            for (int c = 0; c < 3; c++) {
+              view.ycrcb[c] = output.ycrcb[c];
+            }
+          } else {
+            view.bgr = outFrame;
+          }
+          std::string written = sink->write(view, saved);
+          if (verbose && !written.empty()) {
+            std::cerr << tag << "save image: " << written << ENDL;
           }
         }
-      }};
+        cameraMetrics->saves++;
+        update_sink_metrics();
+      },
+      alignSaves);
+
+  // add up the frame buffers before the first frame allocates them, and
+  // reserve them from the budget
+  auto account_memory = [&](const cv::Mat &frame) {
+    MemoryUsage memory;
+    memory.add("capture frame", frame.total() * frame.elemSize());
+    pipeline->memory(frame, memory);
+
+    cv::Size size = conditioner.outputSize(frame.size());
+    uint64_t area = static_cast<uint64_t>(size.area());
+    int channels = pipeline->kind() == FramePipeline::MONO ? 1 : 3;
+    int formats = 0;
+    uint64_t sinkBytes = 0;
+    for (auto &sink : sinks) {
+      formats |= preferredFormat(sink->formats());
+      sinkBytes += sink->memory(size, channels);
+    }
+    // the BGR frame is always counted; sinks fall back to it
+    uint64_t output = area * channels;
+    if ((formats & OUTPUT_YCRCB) && ycrcb) {
+      output += 3 * area;
+    }
+    if (formats & OUTPUT_FLOAT) {
+      output += area * channels * sizeof(float);
+    }
+    memory.add("output frames", output);
+    memory.add("output sinks", sinkBytes);
+    if (!noGUI) {
+      // rendered frame and the three mailbox buffers, and the scaled float
+      // planes and their conversion; Bayer previews are scaled after the
+      // full-size demosaic
+      cv::Size shown = size;
+      if (previewWidth > 0 && previewWidth < size.width) {
+        shown = cv::Size(previewWidth, size.height * previewWidth / size.width);
+      }
+      uint64_t shownArea = static_cast<uint64_t>(shown.area());
+      uint64_t previewBytes = 4 * shownArea * channels +
+                              2 * shownArea * channels * sizeof(float);
+      if (pipeline->kind() == FramePipeline::BAYER && shown != size) {
+        previewBytes += area * 3;
+      }
+      memory.add("preview", previewBytes);
+    }
 
-  int empty_frames = 0;
-  int decimate_counter = 0;
+    if (verbose) {
+      std::cerr << tag << "frame buffers: " << memory.format() << ENDL;
+    }
+    cameraMetrics->setMemory(memory);
+    if (!MemoryBudget::reserve(memory.total(), memoryBudget)) {
+      throw std::runtime_error(
+          "Moria: frame buffers need " + memory.format() +
+          ", over the memory budget of " + format_mib(memoryBudget) + " (" +
+          format_mib(MemoryBudget::reserved()) + " used by other cameras)");
+    }
+    memoryReservation.bytes = memory.total();
+  };
+
+  // raises the decimation when processing falls behind the capture
+  LoadGovernor governor(options->targetLoad(), decimate,
+                        options->maxDecimate());
+  cameraMetrics->decimate = decimate;
+
+  // capture slots (received or dropped frames) not yet consumed by the filter
+  u_int frame_slots = decimate - 1;
+  int64_t processed_frames = 0;
+  auto run_start = std::chrono::steady_clock::now();
 
   //--- GRAB AND WRITE LOOP
-  cap.with_frames([&](cv::Mat &frame) {
-    if (decimate_counter-- == 0) {
-      decimate_counter = decimate;
+  cap.with_frames([&](cv::Mat &frame, const FrameInfo &info) {
+    // everything but waiting for the next frame counts as load
+    struct BusyTime {
+      LoadGovernor &governor;
+      CameraMetrics &metrics;
+      std::chrono::steady_clock::time_point start;
+      ~BusyTime() {
+        auto busy = std::chrono::steady_clock::now() - start;
+        governor.busy(busy);
+        metrics.busy +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(busy)
+                .count();
+      }
+    } busyTime{governor, *cameraMetrics, std::chrono::steady_clock::now()};
+
+    int64_t steps = 0;
+    // the frame rate estimate restarts with this frame
+    bool fpsRestart = false;
+    if (frame.empty()) {
+      if (verbose) {
+        std::cerr << tag << "Empty frame!\n";
+      }
+    } else {
+      if (verbose && info.dropped > 0) {
+        std::cerr << tag << "dropped frames: " << info.dropped << ENDL;
+      }
 
-      if (frame.empty()) {
-        decimate_counter = 0; // ensure we capture the next valid frame
-        if (verbose) {
-          std::cerr << "Empty frame!\n";
-        }
-        empty_frames++;
-        if (empty_frames > 10) {
-          throw std::runtime_error("Moria: encountered too many empty frames.");
+      u_int next =
+          governor.enabled() ? governor.update(decimate, info.dropped) : 0;
+      if (next && next != decimate) {
+        std::cerr << tag << "load " << std::lround(governor.load() * 100)
+                  << "%, decimate: " << decimate << " -> " << next << ENDL;
+        // the filter now samples every next frames: scale its sample rate
+        // now rather than waiting for the frame rate estimate to follow
+        auto old_gain = filterParams.gain();
+        filterParams.samplerate(filterParams.samplerate() * decimate / next);
+        if (pipeline) {
+          pipeline->resetgain(old_gain, filterParams.gain());
         }
-        return true; // continue capture
+        // the first rate after the restart is measured from the next frame;
+        // until then the detector holds the rescaled rate
+        fpscounter.reset();
+        fpsChangeDetector.reset(filterParams.samplerate());
+        fpsRestart = true;
+        frame_slots = std::min(frame_slots, next - 1);
+        decimate = next;
+        cameraMetrics->decimate = decimate;
       }
+      cameraMetrics->load = governor.load();
 
-      fpscounter.update();
-      fps_printer.update();
-      fpsChangeDetector.update();
+      // every decimate slots make one filter sample; frames lost by the
+      // source still count so the filter keeps its time base across gaps
+      int64_t slots = frame_slots + 1 + info.dropped;
+      steps = slots / decimate;
+      frame_slots = static_cast<u_int>(slots % decimate);
+    }
 
-      if (flip) {
-        switch (flip) {
-        case 1:
-          cv::flip(frame, frame, 1);
-          break;
-        case 2:
-          cv::flip(frame, frame, 0);
-          break;
-        case 3:
-          cv::flip(frame, frame, -1);
-          break;
-        default:
-          break;
-        }
+    if (steps > 0) {
+      if (!fpsRestart) {
+        fpscounter.update(steps);
+        fpsChangeDetector.update();
       }
 
-      // apply low pass filter to frame channels
-      cv::cvtColor(frame, frame, cv::COLOR_RGB2XYZ);
-      frame.convertTo(floatFrame, CV_32FC3, 1.0 / 255.0);
-      cv::split(floatFrame, frameChannels);
-      filter[0].apply(filterParams, frameChannels[0]);
-      filter[1].apply(filterParams, frameChannels[1]);
-      filter[2].apply(filterParams, frameChannels[2]);
-      cv::Mat filteredlayers[] = {filter[0].value(), filter[1].value(),
-                                  filter[2].value()};
-      cv::merge(filteredlayers, 3, outFloatFrame);
-      outFloatFrame.convertTo(outFrame, CV_8UC3, 255.0);
-      cv::cvtColor(outFrame, outFrame, cv::COLOR_XYZ2RGB);
+      if (!pipeline) {
+        pipeline = FramePipeline::create(frame, bayer, conditioner, ycrcb);
+        account_memory(frame);
+        if (verbose) {
+          cv::Size filterSize = conditioner.outputSize(frame.size());
+          std::cerr << tag << "filter pipeline: "
+                    << (bayer.enabled() ? "bayer"
+                                        : pipeline->channels() == 1 ? "mono"
+                                                                    : "color")
+                    << ", " << filterSize.width << "x" << filterSize.height
+                    << ENDL;
+        }
 
-      if (writeTimestampInImage) {
-        imprint_timestamp(outFrame);
+        std::chrono::nanoseconds age{0};
+        if (resume &&
+            checkpoint->restore(*pipeline, conditioner.outputSize(frame.size()),
+                                filterParams, age)) {
+          // hold this frame across the downtime, as for a capture gap
+          double missed = std::chrono::duration<double>(age).count() *
+                          filterParams.samplerate();
+          steps += std::max<int64_t>(0, std::llround(missed) - 1);
+          std::cerr << tag << "resumed filter state from "
+                    << checkpoint->file() << " ("
+                    << std::chrono::duration<double>(age).count()
+                    << " s old)" << ENDL;
+        } else if (resume) {
+          std::cerr << tag << "Warning: no checkpoint matching this camera "
+                    << "and filter size; starting with a fresh filter" << ENDL;
+        }
       }
 
-      image_writer.update();
+      // apply low pass filter to frame channels, holding this frame across
+      // any missed samples; flipping is deferred to render_output (flipping
+      // a Bayer mosaic would change its pattern)
+      {
+        TRACE_SCOPE("filter");
+        pipeline->advance(filterParams, frame, steps);
+      }
+      outputStale = OUTPUT_ALL;
+      previewStale = true;
+      processed_frames++;
+      cameraMetrics->frames++;
+      std::chrono::duration<double> running =
+          std::chrono::steady_clock::now() - run_start;
+      cameraMetrics->throughput =
+          processed_frames / std::max(running.count(), 1e-9);
+      cameraMetrics->dropped = cap.droppedFrames();
+      cameraMetrics->reconnects = cap.reconnects();
+      cameraMetrics->gain = filterParams.gain();
+      cameraMetrics->samplerate = filterParams.samplerate();
+
+      scheduler.poll();
     }
 
+    Tracer::poll();
+
     if (!noGUI) {
-      int keyCode = cv::waitKey(5);
-      if (keyCode >= 0) {
+      TRACE_SCOPE("gui");
+      // keys pressed in the preview window since the last frame
+      int keyCode;
+      while (preview->nextKey(keyCode)) {
+        // show the effect of the key with the next preview
+        previewStale = true;
         switch (keyCode) {
         case 114: /*r*/
-          filter[0].reset(filterParams.gain(), frameChannels[0]);
-          filter[1].reset(filterParams.gain(), frameChannels[1]);
-          filter[2].reset(filterParams.gain(), frameChannels[2]);
+          if (pipeline) {
+            pipeline->reset(filterParams.gain());
+            outputStale = OUTPUT_ALL;
+          }
           break;
         case 113: /*q*/
           return false;
@@ -294,7 +791,7 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
         case 102: /*f*/
           showFps = !showFps;
           if (showFps)
-            fps_printer.reset();
+            scheduler.fire(fps_printer);
           break;
         case 99: /*c*/
           showFpsChange = !showFpsChange;
@@ -344,14 +841,42 @@ void Moria::run(std::shared_ptr<MoriaOptions> options) {
         }
       }
 
-      // show live and wait for a key with timeout long enough to show images
-      if (!outFrame.empty()) {
-        imshow("Live", outFrame);
-      } else if (verbose) {
-        std::cerr << "Moria: unable to display empty frame." << ENDL;
+      // hand a downscaled frame to the UI thread at the preview rate; the
+      // full-size output is only rendered for saves
+      if (pipeline && previewStale && (previewDue || previewRate <= 0)) {
+        TRACE_SCOPE("preview");
+        pipeline->renderPreview(previewFrame, previewWidth);
+        flip_frame(previewFrame);
+        if (writeTimestampInImage) {
+          imprint_timestamp(previewFrame, 255);
+        }
+        preview->post(previewFrame);
+        previewStale = false;
+        previewDue = false;
       }
     }
 
     return true;
   });
+
+  save_checkpoint();
+  for (auto &sink : sinks) {
+    sink->close();
+  }
+  update_sink_metrics();
+
+  // summary for finite sources (synthetic frame limit, replay)
+  if (showFps) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - run_start;
+    std::stringstream line;
+    line << tag << "processed " << processed_frames << " frames in "
+         << elapsed.count() << " s ("
+         << processed_frames / std::max(elapsed.count(), 1e-9) << " fps)";
+    if (saveGate.enabled()) {
+      line << ", skipped " << saveGate.skipped() << " unchanged saves";
+    }
+    line << ENDL;
+    std::cerr << line.str();
+  }
 }
@@ -18,12 +18,20 @@
 #include "moria_options.h"
 #include <memory>
 
+class MetricsExporter;
+class PreviewWindow;
+
 class Moria {
 public:
   Moria();
   ~Moria();
   void run(std::shared_ptr<MoriaOptions> options);
-};
 
+private:
+  std::unique_ptr<MetricsExporter> metrics;
+  std::unique_ptr<PreviewWindow> preview;
+
+  void run_camera(std::shared_ptr<MoriaOptions> options, bool multiCamera);
+};
 
 #endif /* BF039872_DA9C_40B9_AD7C_DD98041BDB25 */
@@ -0,0 +1,178 @@
+// Copyright (c) 2020 Nicholas Folse
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// moria-archive: list and extract frames from packed frame archives
+
+#include "FrameArchive.h"
+#include <boost/program_options.hpp>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+
+#define ENDL "\n"
+
+namespace po = boost::program_options;
+
+// same layout as the image file names: YYYY-MM-DD_HH-MM-SS-<ms>
+static std::string format_time(int64_t time, bool utc) {
+  std::time_t seconds = static_cast<std::time_t>(time / 1000000);
+  std::tm calendar;
+  if (utc) {
+    gmtime_r(&seconds, &calendar);
+  } else {
+    localtime_r(&seconds, &calendar);
+  }
+  std::stringstream out;
+  out << std::put_time(&calendar, "%Y-%m-%d_%H-%M-%S") << "-" << std::setw(3)
+      << std::setfill('0') << (time / 1000) % 1000;
+  return out.str();
+}
+
+// accepts YYYY-MM-DD_HH-MM-SS or YYYY-MM-DDTHH:MM:SS
+static int64_t parse_time(const std::string &text, bool utc) {
+  std::tm calendar;
+  std::memset(&calendar, 0, sizeof(calendar));
+  if (!strptime(text.c_str(), "%Y-%m-%d_%H-%M-%S", &calendar) &&
+      !strptime(text.c_str(), "%Y-%m-%dT%H:%M:%S", &calendar)) {
+    throw std::runtime_error("Moria: Invalid time (" + text + ")");
+  }
+  calendar.tm_isdst = -1;
+  std::time_t seconds = utc ? timegm(&calendar) : std::mktime(&calendar);
+  return static_cast<int64_t>(seconds) * 1000000;
+}
+
+static void write_frame(const FrameArchiveReader &archive,
+                        const FrameArchiveEntry &entry,
+                        const std::string &path) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(archive.frame(entry)),
+             static_cast<std::streamsize>(entry.size));
+  if (!file) {
+    throw std::runtime_error("Moria: Unable to write image (" + path + ")");
+  }
+}
+
+static void list(const FrameArchiveReader &archive, bool utc) {
+  for (size_t i = 0; i < archive.size(); i++) {
+    const FrameArchiveEntry &entry = archive.entry(i);
+    std::cout << format_time(entry.time, utc) << " " << entry.offset << " "
+              << entry.size << ENDL;
+  }
+}
+
+static void extract(const FrameArchiveReader &archive, const std::string &dir,
+                    int64_t from, int64_t to, bool utc) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw std::runtime_error("Moria: Unable to create directory (" + dir +
+                             "): " + std::strerror(errno));
+  }
+  size_t extracted = 0;
+  for (size_t i = from > 0 ? archive.find(from) : 0; i < archive.size();
+       i++) {
+    const FrameArchiveEntry &entry = archive.entry(i);
+    if (entry.time < from) {
+      continue;
+    }
+    if (entry.time > to) {
+      break;
+    }
+    write_frame(archive, entry,
+                dir + "/" + format_time(entry.time, utc) + ".jpg");
+    extracted++;
+  }
+  std::cerr << "extracted " << extracted << " frames to " << dir << ENDL;
+}
+
+int main(int argc, char *argv[]) {
+  std::string command, archivePath, target, from, to;
+  bool utc = false;
+
+  po::options_description options("moria-archive options");
+  options.add_options()("help", "show help message")(
+      "utc", po::bool_switch(&utc), "times are UTC (default: local time)")(
+      "from", po::value<std::string>(&from),
+      "extract frames saved at or after this time")(
+      "to", po::value<std::string>(&to),
+      "extract frames saved at or before this time");
+  po::options_description hidden;
+  hidden.add_options()("command", po::value<std::string>(&command))(
+      "archive", po::value<std::string>(&archivePath))(
+      "target", po::value<std::string>(&target))(
+      "time", po::value<std::string>());
+  po::options_description all;
+  all.add(options).add(hidden);
+  po::positional_options_description positional;
+  positional.add("command", 1).add("archive", 1).add("target", 1).add("time",
+                                                                       1);
+
+  try {
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+                  .options(all)
+                  .positional(positional)
+                  .run(),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help") || command.empty() || archivePath.empty()) {
+      std::cout << "usage:" << ENDL
+                << "  moria-archive list <archive.mfa>" << ENDL
+                << "  moria-archive extract <archive.mfa> <dir> [--from T] "
+                   "[--to T]"
+                << ENDL
+                << "  moria-archive get <archive.mfa> <file.jpg> <T>" << ENDL
+                << "times: YYYY-MM-DD_HH-MM-SS or YYYY-MM-DDTHH:MM:SS" << ENDL
+                << ENDL << options << ENDL;
+      return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    FrameArchiveReader archive(archivePath);
+    if (command == "list") {
+      list(archive, utc);
+    } else if (command == "extract" && !target.empty()) {
+      extract(archive, target, from.empty() ? 0 : parse_time(from, utc),
+              to.empty() ? std::numeric_limits<int64_t>::max()
+                         : parse_time(to, utc) + 999999,
+              utc);
+    } else if (command == "get" && !target.empty() && vm.count("time")) {
+      // the last frame saved at or before the time
+      size_t i = archive.find(
+          parse_time(vm["time"].as<std::string>(), utc) + 999999);
+      if (i == archive.size()) {
+        throw std::runtime_error("Moria: Archive is empty (" + archivePath +
+                                 ")");
+      }
+      write_frame(archive, archive.entry(i), target);
+      std::cerr << format_time(archive.entry(i).time, utc) << " -> " << target
+                << ENDL;
+    } else {
+      throw std::runtime_error("Moria: Unknown command (" + command + ")");
+    }
+  } catch (const po::error &ex) {
+    std::cerr << "Runtime exception: " << ex.what() << ENDL;
+    return EXIT_FAILURE;
+  } catch (const std::runtime_error &ex) {
+    std::cerr << "Runtime exception: " << ex.what() << ENDL;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -17,6 +17,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 class MoriaOptions {
 public:
@@ -27,6 +28,7 @@ public:
   virtual int frameHeight() = 0;
   virtual float captureFPS() = 0;
   virtual float saveInterval() = 0;
+  virtual bool alignSaves() = 0;
   virtual std::string outDir() = 0;
   virtual float filterPeriod() = 0;
   virtual bool showFps() = 0;
@@ -37,7 +39,60 @@ public:
   virtual bool verbose() = 0;
   virtual u_int flip() = 0;
   virtual bool noGUI() = 0;
+  virtual float previewRate() = 0;
+  virtual u_int previewWidth() = 0;
   virtual u_int decimate() = 0;
+  virtual float targetLoad() = 0;
+  virtual u_int maxDecimate() = 0;
+  virtual std::string bayerPattern() = 0;
+  virtual u_int rawBits() = 0;
+  virtual bool rawPacked() = 0;
+  virtual std::string roi() = 0;
+  virtual u_int bin() = 0;
+  virtual bool mjpeg() = 0;
+  virtual u_int mjpegScale() = 0;
+  virtual bool synthetic() = 0;
+  virtual u_int syntheticChannels() = 0;
+  virtual u_int syntheticObjects() = 0;
+  virtual float syntheticNoise() = 0;
+  virtual float syntheticRamp() = 0;
+  virtual u_int syntheticFrames() = 0;
+  virtual float syntheticDrop() = 0;
+  virtual std::string replayDir() = 0;
+  virtual bool unpaced() = 0;
+  virtual std::string publishShm() = 0;
+  virtual std::string shmSource() = 0;
+  virtual u_int shmSlots() = 0;
+  virtual bool reconnect() = 0;
+  virtual float reconnectDelay() = 0;
+  virtual std::string checkpoint() = 0;
+  virtual float checkpointInterval() = 0;
+  virtual bool resume() = 0;
+  virtual bool saveImages() = 0;
+  virtual u_int jpegQuality() = 0;
+  virtual u_int jpegSubsampling() = 0;
+  virtual bool jpegProgressive() = 0;
+  virtual std::string colorspace() = 0;
+  virtual std::string saveFloat() = 0;
+  virtual u_int floatCompression() = 0;
+  virtual bool archive() = 0;
+  virtual u_int archiveMaxSize() = 0;
+  virtual float skipUnchanged() = 0;
+  virtual float maxSkip() = 0;
+  virtual std::vector<std::string> outputSizes() = 0;
+  virtual std::string videoCodec() = 0;
+  virtual std::string videoContainer() = 0;
+  virtual u_int videoFps() = 0;
+  virtual u_int videoCrf() = 0;
+  virtual std::string cameraName() = 0;
+  virtual u_int threads() = 0;
+  virtual u_int memoryBudget() = 0;
+  virtual std::string trace() = 0;
+  virtual bool profile() = 0;
+  virtual std::string metrics() = 0;
+  virtual u_int metricsInterval() = 0;
+  // per-camera options when several cameras run in one process
+  virtual std::vector<std::shared_ptr<MoriaOptions>> cameras() = 0;
 
   virtual ~MoriaOptions();
 
@@ -21,6 +21,7 @@
 #include <fstream>
 #include <iostream>
 #include <opencv2/videoio.hpp>
+#include <sstream>
 
 #ifdef __unix__
 #define DEFAULT_CAPTURE cv::CAP_V4L2
@@ -34,7 +35,11 @@
 
 namespace po = boost::program_options;
 
-MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
+MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[])
+    : MoriaOptionsBoost(argc, argv, "") {}
+
+MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[],
+                                     const std::string &cameraConfig) {
   std::string config_file;
 
   // command-line only options
@@ -43,6 +48,33 @@ MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
       "help", "show help message")("config,c",
                                    po::value<std::string>(&config_file),
                                    "name of configuration file.");
+  generic.add_options()(
+      "camera", po::value<std::vector<std::string>>(&cameraConfigs_),
+      "configuration file for one camera; repeat to run several cameras in "
+      "one process (each file overrides the command line)");
+  generic.add_options()("threads",
+                        po::value<u_int>(&threads_)->default_value(0),
+                        "size of the worker pool shared by all cameras "
+                        "(0: one per CPU core)");
+  generic.add_options()(
+      "memory-budget",
+      po::value<u_int>(&memoryBudget_)->default_value(0),
+      "refuse to start a camera whose frame buffers would take the frame "
+      "buffers of all cameras over this many MiB (0: no limit)");
+  generic.add_options()("trace", po::value<std::string>(&trace_),
+                        "record per-stage trace events and write them as "
+                        "Chrome trace JSON to this file on SIGUSR2 and at "
+                        "exit");
+  generic.add_options()("profile", po::bool_switch(&profile_),
+                        "time each processing stage and print a summary "
+                        "table on SIGUSR1 and at exit");
+  generic.add_options()("metrics", po::value<std::string>(&metrics_),
+                        "write Prometheus metrics to this file (for the "
+                        "node_exporter textfile collector)");
+  generic.add_options()(
+      "metrics-interval",
+      po::value<u_int>(&metricsInterval_)->default_value(15),
+      "seconds between metrics file updates");
 
   // command-line and config-file options
   po::options_description config("Configuration");
@@ -64,11 +96,74 @@ MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
   config.add_options()("save-interval",
                        po::value<float>(&saveInterval_)->default_value(10),
                        "interval (seconds) at which frames are saved to disk");
+  config.add_options()("align-saves", po::bool_switch(&alignSaves_),
+                       "save and checkpoint on wall-clock multiples of the "
+                       "interval (e.g. :00, :10, :20 every 10 seconds)");
   config.add_options()("filter-period",
                        po::value<float>(&filterPeriod_)->default_value(1),
                        "virtual shutter speed (seconds)");
   config.add_options()("output,O", po::value<std::string>(&outDir_),
                        "output directory");
+  config.add_options()("save-images",
+                       po::value<bool>(&saveImages_)->default_value(true),
+                       "save JPEG images to the output directory");
+  config.add_options()("jpeg-quality",
+                       po::value<u_int>(&jpegQuality_)->default_value(95),
+                       "JPEG quality (1-100)");
+  config.add_options()("jpeg-subsampling",
+                       po::value<u_int>(&jpegSubsampling_)->default_value(420),
+                       "JPEG chroma subsampling {420, 422, 444}");
+  config.add_options()(
+      "jpeg-progressive",
+      po::value<bool>(&jpegProgressive_)->default_value(false),
+      "write progressive JPEG images");
+  config.add_options()(
+      "colorspace",
+      po::value<std::string>(&colorspace_)->default_value("xyz"),
+      "colour space of the filter {xyz, ycrcb}; ycrcb lets the JPEG writer "
+      "encode the filtered planes directly");
+  config.add_options()("save-float", po::value<std::string>(&saveFloat_),
+                       "also save full-precision images from the filter "
+                       "state {png (16-bit), tiff (16-bit), exr (half)}");
+  config.add_options()(
+      "float-compression",
+      po::value<u_int>(&floatCompression_)->default_value(1),
+      "compression of full-precision images: zlib level (0-9) for png; "
+      "0 for uncompressed tiff and exr");
+  config.add_options()("archive",
+                       po::value<bool>(&archive_)->default_value(false),
+                       "append saved JPEG images to one packed archive per "
+                       "day (see moria-archive)");
+  config.add_options()(
+      "archive-max-size",
+      po::value<u_int>(&archiveMaxSize_)->default_value(0),
+      "start a new archive beyond this size (MiB; 0: one archive per day)");
+  config.add_options()(
+      "skip-unchanged",
+      po::value<float>(&skipUnchanged_)->default_value(0),
+      "skip saving frames whose mean absolute difference to the last saved "
+      "frame is below this many 8-bit levels (0: save every frame)");
+  config.add_options()("max-skip",
+                       po::value<float>(&maxSkip_)->default_value(300),
+                       "save at least this often (seconds) when skipping "
+                       "unchanged frames");
+  config.add_options()(
+      "output-size", po::value<std::vector<std::string>>(&outputSizes_),
+      "also save a reduced-size copy as name:width to <output>/<name>; "
+      "repeat for several sizes (e.g. preview:1280, thumb:320)");
+  config.add_options()("video", po::value<std::string>(&videoCodec_),
+                       "also encode saved frames into one video per day "
+                       "{h264, hevc, av1 or an FFmpeg encoder name}");
+  config.add_options()(
+      "video-container",
+      po::value<std::string>(&videoContainer_)->default_value("mp4"),
+      "video file format {mp4, mkv}");
+  config.add_options()("video-fps",
+                       po::value<u_int>(&videoFps_)->default_value(30),
+                       "playback frame rate of the encoded video");
+  config.add_options()("video-crf",
+                       po::value<u_int>(&videoCrf_)->default_value(23),
+                       "video encoder constant quality (lower is better)");
   config.add_options()("utc", po::value<bool>(&useUTC_)->default_value(false),
                        "use UTC timestamps");
   config.add_options()("timestamp",
@@ -78,9 +173,105 @@ MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
       "flip,f", po::value<u_int>(&flip_)->default_value(0),
       "flip frame {0: no flip, 1: horizontal, 2: vertical, 3: both}");
   config.add_options()("noGUI", po::bool_switch(&noGUI_), "don't show the GUI");
+  config.add_options()(
+      "preview-rate", po::value<float>(&previewRate_)->default_value(5),
+      "frames per second shown in the GUI (0: every filtered frame)");
+  config.add_options()(
+      "preview-width", po::value<u_int>(&previewWidth_)->default_value(960),
+      "scale the GUI preview down to at most this width (0: full size)");
   config.add_options()(
       "decimate", po::value<u_int>(&decimate_)->default_value(1),
-      "only capture 1:N frames (useful if framerate is set by camera)");
+      "only capture 1:N frames (useful if framerate is set by camera); the "
+      "minimum decimation with --target-load");
+  config.add_options()(
+      "target-load", po::value<float>(&targetLoad_)->default_value(0),
+      "raise or lower the decimation to keep the share of time spent "
+      "processing frames at or below this (0-1, e.g. 0.75; 0: fixed "
+      "--decimate)");
+  config.add_options()("max-decimate",
+                       po::value<u_int>(&maxDecimate_)->default_value(8),
+                       "highest decimation used with --target-load");
+  config.add_options()(
+      "bayer", po::value<std::string>(&bayerPattern_),
+      "capture raw Bayer frames with the given pattern {RGGB, GRBG, GBRG, "
+      "BGGR}; frames are filtered before demosaicing");
+  config.add_options()("raw-bits",
+                       po::value<u_int>(&rawBits_)->default_value(8),
+                       "raw Bayer bit depth {8, 10, 12}");
+  config.add_options()("raw-packed", po::bool_switch(&rawPacked_),
+                       "raw Bayer samples are MIPI packed (10/12-bit only)");
+  config.add_options()("roi", po::value<std::string>(&roi_),
+                       "crop frames to x,y,width,height before filtering");
+  config.add_options()("bin", po::value<u_int>(&bin_)->default_value(1),
+                       "average NxN pixel blocks before filtering (e.g. 2 or "
+                       "4); reduces noise, resolution and processing time");
+  config.add_options()("mjpeg", po::bool_switch(&mjpeg_),
+                       "capture compressed MJPEG frames and decode them in "
+                       "moria (gst pipelines must end with \"image/jpeg ! "
+                       "appsink\")");
+  config.add_options()(
+      "mjpeg-scale", po::value<u_int>(&mjpegScale_)->default_value(1),
+      "decode MJPEG frames at 1/N resolution {1, 2, 4, 8}; implies --mjpeg");
+  config.add_options()("synthetic", po::bool_switch(&synthetic_),
+                       "use a generated test scene instead of a camera "
+                       "(uses --width, --height and --fps)");
+  config.add_options()(
+      "synthetic-channels",
+      po::value<u_int>(&syntheticChannels_)->default_value(3),
+      "synthetic scene channels {1: monochrome, 3: color}");
+  config.add_options()(
+      "synthetic-objects",
+      po::value<u_int>(&syntheticObjects_)->default_value(4),
+      "number of moving objects in the synthetic scene");
+  config.add_options()(
+      "synthetic-noise",
+      po::value<float>(&syntheticNoise_)->default_value(8),
+      "standard deviation of synthetic sensor noise (8-bit levels)");
+  config.add_options()(
+      "synthetic-ramp", po::value<float>(&syntheticRamp_)->default_value(60),
+      "period (seconds) of the synthetic brightness ramp; 0 disables");
+  config.add_options()(
+      "synthetic-frames",
+      po::value<u_int>(&syntheticFrames_)->default_value(0),
+      "stop after N synthetic frames (0: run until stopped)");
+  config.add_options()(
+      "synthetic-drop", po::value<float>(&syntheticDrop_)->default_value(0),
+      "probability that a synthetic frame is dropped (tests gap handling)");
+  config.add_options()("replay", po::value<std::string>(&replayDir_),
+                       "replay a directory tree of JPEG images instead of "
+                       "a camera (uses --fps and --mjpeg-scale)");
+  config.add_options()("unpaced", po::bool_switch(&unpaced_),
+                       "deliver synthetic/replayed frames as fast as they "
+                       "can be processed (benchmarking)");
+  config.add_options()("publish-shm", po::value<std::string>(&publishShm_),
+                       "publish captured frames to the named shared-memory "
+                       "ring for other processes");
+  config.add_options()("shm-source", po::value<std::string>(&shmSource_),
+                       "read frames from the named shared-memory ring "
+                       "instead of a camera");
+  config.add_options()("shm-slots",
+                       po::value<u_int>(&shmSlots_)->default_value(8),
+                       "number of frames held by the published ring");
+  config.add_options()("reconnect",
+                       po::value<bool>(&reconnect_)->default_value(true),
+                       "reopen the camera if it stops delivering frames, "
+                       "keeping the filter state");
+  config.add_options()(
+      "reconnect-delay",
+      po::value<float>(&reconnectDelay_)->default_value(30),
+      "maximum delay (seconds) between camera reconnect attempts");
+  config.add_options()("checkpoint", po::value<std::string>(&checkpoint_),
+                       "file to which the filter state is saved periodically "
+                       "and on exit");
+  config.add_options()(
+      "checkpoint-interval",
+      po::value<float>(&checkpointInterval_)->default_value(300),
+      "interval (seconds) at which the filter state is checkpointed");
+  config.add_options()("resume", po::bool_switch(&resume_),
+                       "start from the filter state in the checkpoint file");
+  config.add_options()("name", po::value<std::string>(&cameraName_),
+                       "camera name used in log messages (defaults to the "
+                       "camera configuration file name)");
   config.add_options()("verbose,v", po::bool_switch(&verbose_),
                        "verbose output");
 
@@ -100,6 +291,15 @@ MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
   visible.add(generic).add(config);
 
   po::variables_map vm;
+  if (!cameraConfig.empty()) {
+    // stored first so its values take precedence
+    std::ifstream ifs(cameraConfig.c_str());
+    if (!ifs) {
+      throw std::runtime_error("Moria: Can not open camera config file (" +
+                               cameraConfig + ")");
+    }
+    po::store(po::parse_config_file(ifs, config_file_options), vm);
+  }
   po::store(po::parse_command_line(argc, argv, cmdline_options), vm);
   po::notify(vm);
 
@@ -128,6 +328,29 @@ MoriaOptionsBoost::MoriaOptionsBoost(int argc, char *argv[]) {
     print_version();
     throw exit_success();
   }
+
+  // a drop probability of 1 would never deliver a frame
+  if (!(syntheticDrop_ >= 0 && syntheticDrop_ < 1)) {
+    std::stringstream errs;
+    errs << "Moria: Invalid synthetic drop probability (" << syntheticDrop_
+         << "); expected a value in [0, 1)";
+    throw std::runtime_error(errs.str());
+  }
+
+  if (!cameraConfig.empty()) {
+    if (cameraName_.empty()) {
+      size_t begin = cameraConfig.find_last_of("/\\");
+      begin = begin == std::string::npos ? 0 : begin + 1;
+      size_t end = cameraConfig.find_last_of('.');
+      end = end == std::string::npos || end < begin ? cameraConfig.size() : end;
+      cameraName_ = cameraConfig.substr(begin, end - begin);
+    }
+  } else {
+    for (const auto &camera : cameraConfigs_) {
+      cameras_.push_back(std::shared_ptr<MoriaOptions>(
+          new MoriaOptionsBoost(argc, argv, camera)));
+    }
+  }
 }
 
 MoriaOptionsBoost::~MoriaOptionsBoost() {}
@@ -138,6 +361,7 @@ int MoriaOptionsBoost::frameWidth() { return frameWidth_; }
 int MoriaOptionsBoost::frameHeight() { return frameHeight_; }
 float MoriaOptionsBoost::captureFPS() { return captureFPS_; }
 float MoriaOptionsBoost::saveInterval() { return saveInterval_; }
+bool MoriaOptionsBoost::alignSaves() { return alignSaves_; }
 std::string MoriaOptionsBoost::outDir() { return outDir_; }
 float MoriaOptionsBoost::filterPeriod() { return filterPeriod_; }
 bool MoriaOptionsBoost::showFps() { return showFps_; }
@@ -147,5 +371,61 @@ bool MoriaOptionsBoost::useUTCtime() { return useUTC_; }
 bool MoriaOptionsBoost::writeTimestampInImage() { return writeTimestamp_; }
 bool MoriaOptionsBoost::verbose() { return verbose_; }
 u_int MoriaOptionsBoost::decimate() { return decimate_; }
+float MoriaOptionsBoost::targetLoad() { return targetLoad_; }
+u_int MoriaOptionsBoost::maxDecimate() { return maxDecimate_; }
 bool MoriaOptionsBoost::noGUI() { return noGUI_; }
+float MoriaOptionsBoost::previewRate() { return previewRate_; }
+u_int MoriaOptionsBoost::previewWidth() { return previewWidth_; }
 u_int MoriaOptionsBoost::flip() { return flip_; }
+std::string MoriaOptionsBoost::bayerPattern() { return bayerPattern_; }
+u_int MoriaOptionsBoost::rawBits() { return rawBits_; }
+bool MoriaOptionsBoost::rawPacked() { return rawPacked_; }
+std::string MoriaOptionsBoost::roi() { return roi_; }
+u_int MoriaOptionsBoost::bin() { return bin_; }
+bool MoriaOptionsBoost::mjpeg() { return mjpeg_ || mjpegScale_ > 1; }
+u_int MoriaOptionsBoost::mjpegScale() { return mjpegScale_; }
+bool MoriaOptionsBoost::synthetic() { return synthetic_; }
+u_int MoriaOptionsBoost::syntheticChannels() { return syntheticChannels_; }
+u_int MoriaOptionsBoost::syntheticObjects() { return syntheticObjects_; }
+float MoriaOptionsBoost::syntheticNoise() { return syntheticNoise_; }
+float MoriaOptionsBoost::syntheticRamp() { return syntheticRamp_; }
+u_int MoriaOptionsBoost::syntheticFrames() { return syntheticFrames_; }
+float MoriaOptionsBoost::syntheticDrop() { return syntheticDrop_; }
+std::string MoriaOptionsBoost::replayDir() { return replayDir_; }
+bool MoriaOptionsBoost::unpaced() { return unpaced_; }
+std::string MoriaOptionsBoost::publishShm() { return publishShm_; }
+std::string MoriaOptionsBoost::shmSource() { return shmSource_; }
+u_int MoriaOptionsBoost::shmSlots() { return shmSlots_; }
+bool MoriaOptionsBoost::reconnect() { return reconnect_; }
+float MoriaOptionsBoost::reconnectDelay() { return reconnectDelay_; }
+std::string MoriaOptionsBoost::checkpoint() { return checkpoint_; }
+float MoriaOptionsBoost::checkpointInterval() { return checkpointInterval_; }
+bool MoriaOptionsBoost::resume() { return resume_; }
+bool MoriaOptionsBoost::saveImages() { return saveImages_; }
+u_int MoriaOptionsBoost::jpegQuality() { return jpegQuality_; }
+u_int MoriaOptionsBoost::jpegSubsampling() { return jpegSubsampling_; }
+bool MoriaOptionsBoost::jpegProgressive() { return jpegProgressive_; }
+std::string MoriaOptionsBoost::colorspace() { return colorspace_; }
+std::string MoriaOptionsBoost::saveFloat() { return saveFloat_; }
+u_int MoriaOptionsBoost::floatCompression() { return floatCompression_; }
+bool MoriaOptionsBoost::archive() { return archive_; }
+u_int MoriaOptionsBoost::archiveMaxSize() { return archiveMaxSize_; }
+float MoriaOptionsBoost::skipUnchanged() { return skipUnchanged_; }
+float MoriaOptionsBoost::maxSkip() { return maxSkip_; }
+std::vector<std::string> MoriaOptionsBoost::outputSizes() {
+  return outputSizes_;
+}
+std::string MoriaOptionsBoost::videoCodec() { return videoCodec_; }
+std::string MoriaOptionsBoost::videoContainer() { return videoContainer_; }
+u_int MoriaOptionsBoost::videoFps() { return videoFps_; }
+u_int MoriaOptionsBoost::videoCrf() { return videoCrf_; }
+std::string MoriaOptionsBoost::cameraName() { return cameraName_; }
+u_int MoriaOptionsBoost::threads() { return threads_; }
+u_int MoriaOptionsBoost::memoryBudget() { return memoryBudget_; }
+std::string MoriaOptionsBoost::trace() { return trace_; }
+bool MoriaOptionsBoost::profile() { return profile_; }
+std::string MoriaOptionsBoost::metrics() { return metrics_; }
+u_int MoriaOptionsBoost::metricsInterval() { return metricsInterval_; }
+std::vector<std::shared_ptr<MoriaOptions>> MoriaOptionsBoost::cameras() {
+  return cameras_;
+}
@@ -18,6 +18,7 @@
 #include "moria_options.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 class MoriaOptionsBoost : public MoriaOptions {
 private:
@@ -27,6 +28,7 @@ private:
   int frameHeight_;
   float captureFPS_;
   float saveInterval_;
+  bool alignSaves_;
   float filterPeriod_;
   std::string outDir_;
   bool showFps_ = false;
@@ -36,7 +38,63 @@ private:
   bool verbose_;
   u_int flip_;
   bool noGUI_;
+  float previewRate_;
+  u_int previewWidth_;
   u_int decimate_;
+  float targetLoad_;
+  u_int maxDecimate_;
+  std::string bayerPattern_;
+  u_int rawBits_;
+  bool rawPacked_;
+  std::string roi_;
+  u_int bin_;
+  bool mjpeg_;
+  u_int mjpegScale_;
+  bool synthetic_;
+  u_int syntheticChannels_;
+  u_int syntheticObjects_;
+  float syntheticNoise_;
+  float syntheticRamp_;
+  u_int syntheticFrames_;
+  float syntheticDrop_;
+  std::string replayDir_;
+  bool unpaced_;
+  std::string publishShm_;
+  std::string shmSource_;
+  u_int shmSlots_;
+  bool reconnect_;
+  float reconnectDelay_;
+  std::string checkpoint_;
+  float checkpointInterval_;
+  bool resume_;
+  bool saveImages_;
+  u_int jpegQuality_;
+  u_int jpegSubsampling_;
+  bool jpegProgressive_;
+  std::string colorspace_;
+  std::string saveFloat_;
+  u_int floatCompression_;
+  bool archive_;
+  u_int archiveMaxSize_;
+  float skipUnchanged_;
+  float maxSkip_;
+  std::vector<std::string> outputSizes_;
+  std::string videoCodec_;
+  std::string videoContainer_;
+  u_int videoFps_;
+  u_int videoCrf_;
+  std::string cameraName_;
+  u_int threads_;
+  u_int memoryBudget_;
+  std::string trace_;
+  bool profile_;
+  std::string metrics_;
+  u_int metricsInterval_;
+  std::vector<std::string> cameraConfigs_;
+  std::vector<std::shared_ptr<MoriaOptions>> cameras_;
+
+  // options for one camera: cameraConfig overrides the command line
+  MoriaOptionsBoost(int argc, char *argv[], const std::string &cameraConfig);
 
 public:
   virtual int deviceID();
@@ -46,6 +104,7 @@ public:
   virtual int frameHeight();
   virtual float captureFPS();
   virtual float saveInterval();
+  virtual bool alignSaves();
   virtual std::string outDir();
   virtual float filterPeriod();
   virtual bool showFps();
@@ -56,7 +115,59 @@ public:
   virtual bool verbose();
   virtual u_int flip();
   virtual bool noGUI();
+  virtual float previewRate();
+  virtual u_int previewWidth();
   virtual u_int decimate();
+  virtual float targetLoad();
+  virtual u_int maxDecimate();
+  virtual std::string bayerPattern();
+  virtual u_int rawBits();
+  virtual bool rawPacked();
+  virtual std::string roi();
+  virtual u_int bin();
+  virtual bool mjpeg();
+  virtual u_int mjpegScale();
+  virtual bool synthetic();
+  virtual u_int syntheticChannels();
+  virtual u_int syntheticObjects();
+  virtual float syntheticNoise();
+  virtual float syntheticRamp();
+  virtual u_int syntheticFrames();
+  virtual float syntheticDrop();
+  virtual std::string replayDir();
+  virtual bool unpaced();
+  virtual std::string publishShm();
+  virtual std::string shmSource();
+  virtual u_int shmSlots();
+  virtual bool reconnect();
+  virtual float reconnectDelay();
+  virtual std::string checkpoint();
+  virtual float checkpointInterval();
+  virtual bool resume();
+  virtual bool saveImages();
+  virtual u_int jpegQuality();
+  virtual u_int jpegSubsampling();
+  virtual bool jpegProgressive();
+  virtual std::string colorspace();
+  virtual std::string saveFloat();
+  virtual u_int floatCompression();
+  virtual bool archive();
+  virtual u_int archiveMaxSize();
+  virtual float skipUnchanged();
+  virtual float maxSkip();
+  virtual std::vector<std::string> outputSizes();
+  virtual std::string videoCodec();
+  virtual std::string videoContainer();
+  virtual u_int videoFps();
+  virtual u_int videoCrf();
+  virtual std::string cameraName();
+  virtual u_int threads();
+  virtual u_int memoryBudget();
+  virtual std::string trace();
+  virtual bool profile();
+  virtual std::string metrics();
+  virtual u_int metricsInterval();
+  virtual std::vector<std::shared_ptr<MoriaOptions>> cameras();
 
   MoriaOptionsBoost(int argc, char *argv[]);
   virtual ~MoriaOptionsBoost();
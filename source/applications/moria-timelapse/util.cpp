@@ -15,6 +15,7 @@
 
 #include "util.h"
 #include "moria-timelapse/moria-timelapse-version.h"
+#include <fstream>
 #include <iostream>
 
 #define ENDL "\n"
@@ -32,4 +33,11 @@ void print_version() {
             << ENDL;
   std::cout << "Licensed under the " << MORIA_TIMELAPSE_LICENSE << ENDL;
   std::cout << "================================================" << ENDL;
-}
\ No newline at end of file
+}
+bool write_file(const std::string &path,
+                const std::vector<unsigned char> &data) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(data.data()),
+             static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(file);
+}
@@ -15,6 +15,13 @@
 #ifndef C2C12748_F96F_47A6_BB0B_2B9B2AFAE223
 #define C2C12748_F96F_47A6_BB0B_2B9B2AFAE223
 
+#include <string>
+#include <vector>
+
 void print_version();
 
+// write data to a new or truncated file; returns false on failure
+bool write_file(const std::string &path,
+                const std::vector<unsigned char> &data);
+
 #endif /* C2C12748_F96F_47A6_BB0B_2B9B2AFAE223 */